@@ -0,0 +1,162 @@
+/* bench_ipc.c — compares the text and binary agent protocols on LIST of many binds and on pipelined VERIFY
+ * Single-file, no external deps. Talks to a running clipwatch over its unix socket.
+ * Build: gcc -O2 -o bench_ipc bench_ipc.c
+ * Run: ./bench_ipc [binds] [verifies]       (defaults 100000 100000; test_binary_ipc.sh runs it against an isolated agent)
+ * Binds random fingerprints, then times LIST and pipelined VERIFY / VERIFYADDR over both protocols and checks
+ * that both return the same answers. Exits non-zero on any mismatch. The random binds are left in the agent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define BIN_HDR 12
+#define OP_BIND 1
+#define OP_VERIFY 3
+#define OP_VERIFYADDR 6
+#define OP_LIST 7
+#define ST_OK 0
+#define ST_NOTBOUND 4
+#define FL_MORE 1
+#define WINDOW 512
+#define ADDR_QUERIES 200
+
+static double now_ms(void) { struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return t.tv_sec * 1e3 + t.tv_nsec / 1e6; }
+static void put32(unsigned char *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static uint32_t get32(const unsigned char *p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+static void die(const char *msg) { fprintf(stderr, "bench_ipc: %s\n", msg); exit(2); }
+
+static long recv_calls;
+
+static int agent_connect(int binary) {
+    const char *sock = getenv("ULTRALOCK_SOCK"); char path[1024];
+    if (sock && sock[0]) snprintf(path, sizeof(path), "%s", sock);
+    else { const char *xdg = getenv("XDG_RUNTIME_DIR"); if (xdg && xdg[0]) snprintf(path, sizeof(path), "%s/ultralock.sock", xdg); else snprintf(path, sizeof(path), "%s/.local/share/ultralock.sock", getenv("HOME")); }
+    int s = socket(AF_UNIX, SOCK_STREAM, 0); if (s < 0) die("socket");
+    struct sockaddr_un addr; memset(&addr, 0, sizeof(addr)); addr.sun_family = AF_UNIX; strncpy(addr.sun_path, path, sizeof(addr.sun_path)-1);
+    if (connect(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) die("cannot connect to agent socket");
+    if (binary) {
+        char r[16] = {0}; size_t got = 0;
+        if (send(s, "BINARY\n", 7, 0) != 7) die("send");
+        while (got < 10) { ssize_t n = recv(s, r + got, 10 - got, 0); if (n <= 0) die("negotiation"); got += n; }
+        if (strncmp(r, "OK BINARY\n", 10) != 0) die("agent refused binary protocol");
+    }
+    return s;
+}
+
+static void send_all(int s, const void *p, size_t len) {
+    while (len) { ssize_t n = send(s, p, len, 0); if (n <= 0) die("send"); p = (const char*)p + n; len -= n; }
+}
+
+// Buffered reader shared by both protocols
+static unsigned char rbuf[1 << 20]; static size_t rlen, rpos;
+static void fill(int s) {
+    if (rpos) { memmove(rbuf, rbuf + rpos, rlen - rpos); rlen -= rpos; rpos = 0; }
+    ssize_t n = recv(s, rbuf + rlen, sizeof(rbuf) - rlen, 0); recv_calls++;
+    if (n <= 0) die("agent closed the connection");
+    rlen += n;
+}
+static char *read_line(int s) {
+    while (1) {
+        unsigned char *nl = memchr(rbuf + rpos, '\n', rlen - rpos);
+        if (nl) { *nl = '\0'; char *line = (char*)rbuf + rpos; rpos = nl - rbuf + 1; return line; }
+        fill(s);
+    }
+}
+// returns the payload; header fields through the out parameters
+static unsigned char *read_frame(int s, int *op, int *status, int *flags, uint32_t *id, uint32_t *plen) {
+    while (rlen - rpos < BIN_HDR || rlen - rpos < BIN_HDR + get32(rbuf + rpos)) fill(s);
+    unsigned char *h = rbuf + rpos;
+    *plen = get32(h); *op = h[4]; *status = h[5]; *flags = h[6] << 8 | h[7]; *id = get32(h + 8);
+    rpos += BIN_HDR + *plen;
+    return h + BIN_HDR;
+}
+static void reset_reader(void) { rlen = rpos = 0; recv_calls = 0; }
+
+static size_t frame(unsigned char *out, int op, uint32_t id, const void *payload, uint32_t plen) {
+    put32(out, plen); out[4] = op; out[5] = 0; out[6] = 0; out[7] = 0; put32(out + 8, id);
+    memcpy(out + BIN_HDR, payload, plen);
+    return BIN_HDR + plen;
+}
+
+static void hex(const unsigned char *in, char out[65]) { static const char hx[] = "0123456789abcdef"; for (int i=0;i<32;i++) { out[i*2] = hx[in[i] >> 4]; out[i*2+1] = hx[in[i] & 15]; } out[64] = '\0'; }
+
+int main(int argc, char **argv) {
+    long nb = argc > 1 ? atol(argv[1]) : 100000, nv = argc > 2 ? atol(argv[2]) : 100000;
+    if (nb <= 0 || nv <= 0) die("usage: bench_ipc [binds] [verifies]");
+    unsigned char *fps = malloc(32 * (nb + nv)); unsigned char *wbuf = malloc(WINDOW * 600);
+    char (*addrs)[48] = malloc(48 * ADDR_QUERIES);
+    int *expect = malloc(sizeof(int) * nv), *got_text = malloc(sizeof(int) * nv), *got_bin = malloc(sizeof(int) * nv);
+    if (!fps || !wbuf || !addrs || !expect || !got_text || !got_bin) die("out of memory");
+    FILE *ur = fopen("/dev/urandom", "rb"); if (!ur || fread(fps, 32, nb + nv, ur) != (size_t)(nb + nv)) die("/dev/urandom"); fclose(ur);
+    for (int i=0;i<ADDR_QUERIES;i++) snprintf(addrs[i], sizeof(addrs[i]), "bc1qbench%032x", (unsigned)i * 2654435761u);
+
+    int sb = agent_connect(1), st = agent_connect(0);
+    int op, status, flags; uint32_t id, plen;
+
+    // bind nb random fingerprints (binary, windowed pipelining)
+    double t0 = now_ms();
+    for (long i=0;i<nb;i+=WINDOW) {
+        long w = nb - i < WINDOW ? nb - i : WINDOW; size_t len = 0;
+        for (long k=0;k<w;k++) len += frame(wbuf + len, OP_BIND, i + k, fps + 32 * (i + k), 32);
+        send_all(sb, wbuf, len);
+        for (long k=0;k<w;k++) { read_frame(sb, &op, &status, &flags, &id, &plen); if (status != ST_OK) die("BIND failed (table full?)"); }
+    }
+    printf("BIND      %8ld binds          binary %9.1f ms\n", nb, now_ms() - t0);
+
+    // LIST: text
+    reset_reader(); t0 = now_ms();
+    send_all(st, "LIST\n", 5);
+    long text_entries = 0; char *line;
+    while (strcmp((line = read_line(st)), "END") != 0) if (strncmp(line, "FP ", 3) == 0) text_entries++;
+    double text_ms = now_ms() - t0; long text_recvs = recv_calls;
+    // LIST: binary
+    reset_reader(); t0 = now_ms();
+    { unsigned char f[BIN_HDR]; send_all(sb, f, frame(f, OP_LIST, 1, NULL, 0)); }
+    long bin_entries = 0;
+    do { read_frame(sb, &op, &status, &flags, &id, &plen); if (op != OP_LIST || status != ST_OK) die("LIST failed"); bin_entries += plen / 40; } while (flags & FL_MORE);
+    double bin_ms = now_ms() - t0;
+    printf("LIST      %8ld entries        text   %9.1f ms (%ld recv)   binary %9.1f ms (%ld recv)\n", text_entries, text_ms, text_recvs, bin_ms, recv_calls);
+    if (text_entries != bin_entries || bin_entries < nb) die("LIST entry counts differ");
+
+    // pipelined VERIFY: every other query is a bound fingerprint
+    for (long i=0;i<nv;i++) expect[i] = (i % 2 == 0);
+    reset_reader(); t0 = now_ms();
+    for (long i=0;i<nv;i+=WINDOW) {
+        long w = nv - i < WINDOW ? nv - i : WINDOW; size_t len = 0;
+        for (long k=0;k<w;k++) { const unsigned char *fp = expect[i+k] ? fps + 32 * ((i + k) % nb) : fps + 32 * (nb + i + k); char hx[65]; hex(fp, hx); len += sprintf((char*)wbuf + len, "VERIFY %s\n", hx); }
+        send_all(st, wbuf, len);
+        for (long k=0;k<w;k++) got_text[i+k] = strcmp(read_line(st), "OK") == 0;
+    }
+    text_ms = now_ms() - t0;
+    reset_reader(); t0 = now_ms();
+    for (long i=0;i<nv;i+=WINDOW) {
+        long w = nv - i < WINDOW ? nv - i : WINDOW; size_t len = 0;
+        for (long k=0;k<w;k++) len += frame(wbuf + len, OP_VERIFY, i + k, expect[i+k] ? fps + 32 * ((i + k) % nb) : fps + 32 * (nb + i + k), 32);
+        send_all(sb, wbuf, len);
+        for (long k=0;k<w;k++) { read_frame(sb, &op, &status, &flags, &id, &plen); if (id >= (uint32_t)nv) die("bad request id"); got_bin[id] = status == ST_OK; }
+    }
+    bin_ms = now_ms() - t0;
+    printf("VERIFY    %8ld pipelined      text   %9.1f ms              binary %9.1f ms\n", nv, text_ms, bin_ms);
+    for (long i=0;i<nv;i++) if (got_text[i] != expect[i] || got_bin[i] != expect[i]) die("VERIFY answers differ");
+
+    // pipelined VERIFYADDR: audited, so text pays one fsync per query and binary one per batch
+    reset_reader(); t0 = now_ms();
+    { size_t len = 0; for (int i=0;i<ADDR_QUERIES;i++) len += sprintf((char*)wbuf + len, "VERIFYADDR %s\n", addrs[i]); send_all(st, wbuf, len); }
+    for (int i=0;i<ADDR_QUERIES;i++) if (strcmp(read_line(st), "ERR notbound") != 0) die("VERIFYADDR (text) unexpected answer");
+    text_ms = now_ms() - t0;
+    reset_reader(); t0 = now_ms();
+    { size_t len = 0; for (int i=0;i<ADDR_QUERIES;i++) len += frame(wbuf + len, OP_VERIFYADDR, i, addrs[i], strlen(addrs[i])); send_all(sb, wbuf, len); }
+    for (int i=0;i<ADDR_QUERIES;i++) { read_frame(sb, &op, &status, &flags, &id, &plen); if (status != ST_NOTBOUND) die("VERIFYADDR (binary) unexpected answer"); }
+    bin_ms = now_ms() - t0;
+    printf("VERIFYADDR %7d pipelined      text   %9.1f ms              binary %9.1f ms\n", ADDR_QUERIES, text_ms, bin_ms);
+
+    close(sb); close(st);
+    printf("bench OK\n");
+    return 0;
+}
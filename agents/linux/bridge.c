@@ -1,6 +1,7 @@
 /* bridge.c — local HTTP bridge for UltraLock agent
  * Single-file, no external deps. Listens on 127.0.0.1:0 and requires a generated token header.
- * Forwards browser bind requests to the agent unix socket (BINDADDR / UNBINDADDR / LIST).
+ * Forwards browser bind requests to the agent unix socket (BINDADDR / UNBINDADDR / LIST / UNBINDORIGIN).
+ * An optional origin=<url-encoded origin> query parameter selects the agent bind namespace of that origin.
  * Build: gcc -o bridge bridge.c
  */
 
@@ -36,6 +37,25 @@ static int forward_to_agent(const char *sockpath, const char *cmd, char *resp, s
     resp[r]='\0'; close(s); return 0;
 }
 
+// URL-decoded query parameter; 0 if absent or if it decodes to anything but printable ASCII (keeps the agent line intact)
+static int query_param(const char *path, const char *name, char *out, size_t out_sz){
+    char key[64]; snprintf(key, sizeof(key), "%s=", name);
+    const char *q = strchr(path, '?'); if (!q) return 0;
+    const char *v = q + 1;
+    while (strncmp(v, key, strlen(key)) != 0) { v = strchr(v, '&'); if (!v) return 0; v++; }
+    v += strlen(key);
+    size_t n = 0;
+    while (*v && *v != '&') {
+        unsigned ch = (unsigned char)*v++;
+        if (ch == '+') ch = ' ';
+        else if (ch == '%') { unsigned x; if (sscanf(v, "%2x", &x) != 1 || !v[0] || !v[1]) return 0; ch = x; v += 2; }
+        if (ch < 32 || ch > 126 || n + 1 >= out_sz) return 0;
+        out[n++] = ch;
+    }
+    out[n] = '\0';
+    return n > 0;
+}
+
 int main(void){
     const char *sockpath = getenv("XDG_RUNTIME_DIR");
     char agent_sock[1024]; if (sockpath && sockpath[0]) snprintf(agent_sock, sizeof(agent_sock), "%s/ultralock.sock", sockpath); else {
@@ -79,19 +99,25 @@ int main(void){
         }
         // route
         char resp_body[4096] = {0}; int ok = 0;
+        // optional origin namespace, appended to the agent command as " ORIGIN <o>"
+        char origin[256] = {0}, osuffix[300] = {0}; int has_origin = query_param(path, "origin", origin, sizeof(origin));
+        if (has_origin) snprintf(osuffix, sizeof(osuffix), " ORIGIN %s", origin);
         if (strncmp(path, "/bindaddr", 9) == 0) {
             // extract address param
             char addr[2048] = {0}; char *a = strstr(path, "address="); if (a) { a += strlen("address="); int i=0; while (a[i] && a[i] != '&' && i < (int)sizeof(addr)-1) { addr[i]=a[i]; i++; } addr[i]='\0'; }
             if (!addr[0]) { snprintf(resp_body, sizeof(resp_body), "ERR invalid-addr\n"); }
             else {
-                char cmd[4096]; snprintf(cmd, sizeof(cmd), "BINDADDR %s\n", addr);
+                char cmd[4096]; snprintf(cmd, sizeof(cmd), "BINDADDR %s%s\n", addr, osuffix);
                 if (forward_to_agent(agent_sock, cmd, resp_body, sizeof(resp_body)) == 0) ok = 1; else snprintf(resp_body, sizeof(resp_body), "ERR agent\n");
             }
         } else if (strncmp(path, "/unbindaddr", 11) == 0) {
             char addr[2048] = {0}; char *a = strstr(path, "address="); if (a) { a += strlen("address="); int i=0; while (a[i] && a[i] != '&' && i < (int)sizeof(addr)-1) { addr[i]=a[i]; i++; } addr[i]='\0'; }
-            if (!addr[0]) snprintf(resp_body, sizeof(resp_body), "ERR invalid-addr\n"); else { char cmd[4096]; snprintf(cmd, sizeof(cmd), "UNBINDADDR %s\n", addr); if (forward_to_agent(agent_sock, cmd, resp_body, sizeof(resp_body)) == 0) ok = 1; else snprintf(resp_body, sizeof(resp_body), "ERR agent\n"); }
+            if (!addr[0]) snprintf(resp_body, sizeof(resp_body), "ERR invalid-addr\n"); else { char cmd[4096]; snprintf(cmd, sizeof(cmd), "UNBINDADDR %s%s\n", addr, osuffix); if (forward_to_agent(agent_sock, cmd, resp_body, sizeof(resp_body)) == 0) ok = 1; else snprintf(resp_body, sizeof(resp_body), "ERR agent\n"); }
+        } else if (strncmp(path, "/unbindorigin", 13) == 0) {
+            // bulk unbind of every address bound for one origin
+            if (!has_origin) snprintf(resp_body, sizeof(resp_body), "ERR invalid-origin\n"); else { char cmd[512]; snprintf(cmd, sizeof(cmd), "UNBINDORIGIN %s\n", origin); if (forward_to_agent(agent_sock, cmd, resp_body, sizeof(resp_body)) == 0) ok = 1; else snprintf(resp_body, sizeof(resp_body), "ERR agent\n"); }
         } else if (strncmp(path, "/list", 5) == 0) {
-            char cmd[] = "LIST\n"; if (forward_to_agent(agent_sock, cmd, resp_body, sizeof(resp_body)) == 0) ok = 1; else snprintf(resp_body, sizeof(resp_body), "ERR agent\n");
+            char cmd[512]; snprintf(cmd, sizeof(cmd), "LIST%s\n", osuffix); if (forward_to_agent(agent_sock, cmd, resp_body, sizeof(resp_body)) == 0) ok = 1; else snprintf(resp_body, sizeof(resp_body), "ERR agent\n");
         } else {
             snprintf(resp_body, sizeof(resp_body), "ERR unknown\n");
         }
@@ -1,27 +1,43 @@
 /* clipwatch.c — UltraLock Linux clipboard watcher prototype (X11)
  * Single-file, minimal prototype. No external dependencies except Xlib and libc.
- * Build: gcc -o clipwatch clipwatch.c -lX11 -lm
+ * Build: gcc -o clipwatch clipwatch.c -lX11 -lm -pthread
  * Run: ./clipwatch
+ *      ./clipwatch --multi            (one agent for every local X session under /tmp/.X11-unix)
+ *      ./clipwatch --display :1 --display :2 --socket /run/ultralock.sock
+ *      ./clipwatch --ns-limit 10000   (cap binds per (user, origin) namespace)
+ *      ./clipwatch --scan payouts.csv [--origin O] [--threads N]   (report unbound addresses; needs the running agent)
  *
  * Security model: session-local device-salt stored in $XDG_DATA_HOME/ultralock/device_salt (mode 600).
  * The agent computes the same fingerprint as UltraLock.js (canonical text + origin placeholder + device/session salts)
  * and enforces clipboard integrity by replacing suspicious clipboard content with a blocking message.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/select.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <limits.h>
 #include <sys/un.h>
 #include <netinet/in.h>
 #include <signal.h>
+#include <setjmp.h>
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stddef.h>
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 
@@ -55,8 +71,15 @@ void sha256_init(SHA256_CTX *c) {
     c->bitcount = 0;
 }
 
+// One round with the working variables renamed instead of shifted, so they stay in registers (8 rounds per loop turn)
+#define SHA256_ROUND(a,b,c,d,e,f,g,h,i) do { \
+    unsigned int t1 = h + (rotr(e,6) ^ rotr(e,11) ^ rotr(e,25)) + ((e & f) ^ (~e & g)) + K[i] + w[i]; \
+    unsigned int t2 = (rotr(a,2) ^ rotr(a,13) ^ rotr(a,22)) + ((a & b) ^ (a & c) ^ (b & c)); \
+    d += t1; h = t1 + t2; } while (0)
+
 void sha256_transform(SHA256_CTX *c, const unsigned char *buf) {
-    unsigned int w[64], s0, s1, maj, t1, t2, ch;    for (int i=0;i<16;i++) {
+    unsigned int w[64], s0, s1;
+    for (int i=0;i<16;i++) {
         w[i] = (unsigned int)buf[i*4]<<24 | (unsigned int)buf[i*4+1]<<16 | (unsigned int)buf[i*4+2]<<8 | (unsigned int)buf[i*4+3];
     }
     for (int i=16;i<64;i++) {
@@ -64,27 +87,28 @@ void sha256_transform(SHA256_CTX *c, const unsigned char *buf) {
         s1 = rotr(w[i-2],17) ^ rotr(w[i-2],19) ^ (w[i-2]>>10);
         w[i] = w[i-16] + s0 + w[i-7] + s1;
     }
-    unsigned int state[8]; for (int i=0;i<8;i++) state[i]=c->state[i];
-    for (int i=0;i<64;i++) {
-        s1 = rotr(state[4],6) ^ rotr(state[4],11) ^ rotr(state[4],25);
-        ch = (state[4] & state[5]) ^ ((~state[4]) & state[6]);
-        t1 = state[7] + s1 + ch + K[i] + w[i];
-        s0 = rotr(state[0],2) ^ rotr(state[0],13) ^ rotr(state[0],22);
-        maj = (state[0] & state[1]) ^ (state[0] & state[2]) ^ (state[1] & state[2]);
-        t2 = s0 + maj;
-        state[7]=state[6]; state[6]=state[5]; state[5]=state[4]; state[4]=state[3]+t1;
-        state[3]=state[2]; state[2]=state[1]; state[1]=state[0]; state[0]=t1 + t2;
+    unsigned int a = c->state[0], b = c->state[1], cc = c->state[2], d = c->state[3], e = c->state[4], f = c->state[5], g = c->state[6], h = c->state[7];
+    for (int i=0;i<64;i+=8) {
+        SHA256_ROUND(a,b,cc,d,e,f,g,h,i);   SHA256_ROUND(h,a,b,cc,d,e,f,g,i+1);
+        SHA256_ROUND(g,h,a,b,cc,d,e,f,i+2); SHA256_ROUND(f,g,h,a,b,cc,d,e,i+3);
+        SHA256_ROUND(e,f,g,h,a,b,cc,d,i+4); SHA256_ROUND(d,e,f,g,h,a,b,cc,i+5);
+        SHA256_ROUND(cc,d,e,f,g,h,a,b,i+6); SHA256_ROUND(b,cc,d,e,f,g,h,a,i+7);
     }
-    for (int i=0;i<8;i++) c->state[i] += state[i];
+    c->state[0] += a; c->state[1] += b; c->state[2] += cc; c->state[3] += d; c->state[4] += e; c->state[5] += f; c->state[6] += g; c->state[7] += h;
 }
 
+// Whole blocks are hashed straight from the input; only partial blocks go through the buffer
 void sha256_update(SHA256_CTX *c, const unsigned char *data, size_t len) {
-    size_t i=0;
-    while (len--) {
-        c->buffer[(c->bitcount/8) % 64] = data[i++];
-        c->bitcount += 8;
-        if ((c->bitcount % 512) == 0) sha256_transform(c, c->buffer);
+    size_t fill = (c->bitcount/8) % 64;
+    c->bitcount += (unsigned long long)len * 8;
+    if (fill) {
+        size_t n = 64 - fill < len ? 64 - fill : len;
+        memcpy(c->buffer + fill, data, n); data += n; len -= n;
+        if (fill + n < 64) return;
+        sha256_transform(c, c->buffer);
     }
+    for (; len >= 64; data += 64, len -= 64) sha256_transform(c, data);
+    memcpy(c->buffer, data, len);
 }
 
 void sha256_final(SHA256_CTX *c, unsigned char out[32]) {
@@ -108,6 +132,10 @@ void sha256_final(SHA256_CTX *c, unsigned char out[32]) {
     }
 }
 
+void sha256_raw(const char *in, unsigned char out[32]) {
+    SHA256_CTX ctx; sha256_init(&ctx); sha256_update(&ctx, (const unsigned char*)in, strlen(in)); sha256_final(&ctx, out);
+}
+
 void sha256_hex(const char *in, char out[65]) {
     unsigned char digest[32]; SHA256_CTX ctx; sha256_init(&ctx); sha256_update(&ctx, (const unsigned char*)in, strlen(in)); sha256_final(&ctx, digest);
     for (int i=0;i<32;i++) {
@@ -122,10 +150,174 @@ void sha256_hex(const char *in, char out[65]) {
 #define DEVICE_DIR_FALLBACK ".local/share"
 #define DEVICE_SALT_FILE "ultralock_device_salt"
 #define MAX_CLIP 4096
+#define MAX_CLIENTS 250 // socket is world-connectable; all clients plus srv and snapshot fit one SCM_RIGHTS message (253)
+#define MAX_CLIENTS_PER_UID 16 // one user cannot take every slot
+#define IPC_IDLE_MS 60000 // clients that neither send nor drain for this long are dropped
+
+// Multi-display mode: one agent attached to many X sessions
+#define X11_SOCKET_DIR "/tmp/.X11-unix"
+#define MAX_DISPLAYS 64
+#define RESCAN_MS 5000
+
+// IPC binds store, sharded by namespace = (uid, origin). Each namespace owns an open-addressing hash table of
+// raw digests, so lookups touch one shard and a whole origin is dropped by freeing its table.
+#define MAX_BINDS 1048576
+#define NS_MAX_BINDS 262144
+#define NS_BUCKETS 1024
+#define UID_MAX_BINDS 262144 // per user over all origins, so one user cannot fill the agent
+#define UID_MAX_NS 1024 // per user, so one user cannot create origins without bound
+#define UQ_BUCKETS 256
+#define JOURNAL_MIN 65536 // journal lines tolerated on top of the bind count before the snapshot is rewritten
+#define JOURNAL_BUF (1u << 20) // unflushed journal bytes (unaudited BINDs) that force a flush with the next batch
+#define MAX_ORIGIN 256
+#define DEFAULT_ORIGIN "local-origin"
+struct bind_entry { unsigned char fp[32]; long ts; int used; };
+struct bind_ns;
+struct uid_quota { uid_t uid; size_t binds, ns; struct bind_ns *list; struct uid_quota *next; }; // what one user holds, over all origins
+struct bind_ns {
+    uid_t uid; char origin[MAX_ORIGIN]; struct uid_quota *quota;
+    struct bind_entry *slots; size_t cap, count, limit;
+    unsigned long lookups, hits;
+    struct bind_ns *next; // hash chain in ns_table
+    struct bind_ns *unext, **uprev; // the owner's namespaces (quota->list), so per-user walks skip other tenants
+};
+
+// IPC framing. Text protocol: one command per '\n'-terminated line. Binary protocol (negotiated with the text
+// line "BINARY", answered by "OK BINARY\n"): frames of u32 payload length | u8 op | u8 status | u16 flags |
+// u32 request id | payload, integers big-endian. Responses echo op and request id; commands that write the
+// audit log complete after their batch's single fsync, so responses can overtake each other and clients
+// match them by id. Digests travel as raw 32 bytes.
+#define IPC_BUF 65536
+#define BIN_HDR 12
+#define BIN_MAX_PAYLOAD 4096
+#define OP_BIND 1
+#define OP_UNBIND 2
+#define OP_VERIFY 3
+#define OP_BINDADDR 4
+#define OP_UNBINDADDR 5
+#define OP_VERIFYADDR 6
+#define OP_LIST 7
+#define OP_UNBINDORIGIN 8
+#define ST_OK 0
+#define ST_INVALID 1
+#define ST_FULL 2
+#define ST_NOTFOUND 3
+#define ST_NOTBOUND 4
+#define ST_UNKNOWN 5
+#define FL_MORE 1
+#define FL_ORIGIN 2
+#define LIST_BATCH 1024
+#define SNAP_MAGIC "ULSNAP1\n"
+#define HANDOFF_MAX_FDS (MAX_CLIENTS + 2)
+#define HANDOFF_TIMEOUT_MS 10000
+#define SCAN_CHUNK (4u << 20)
+#define SCAN_BLOCK (64u << 20)
+#define SCAN_MAX_THREADS 256
+#define SCAN_MEMO 4096
+#define SCAN_MEMO_TOK 91 // longest bc1 / 0x candidate + 1; invoices are not memoized
+// responses are queued per client in chunks and flushed with one sendmsg() per event loop turn
+#define OUT_CHUNK 65536
+#define OUT_MAX_CHUNKS 512
+struct outq { struct iovec v[OUT_MAX_CHUNKS]; char *base[OUT_MAX_CHUNKS]; int n; };
+
+// Tracing: USDT probes (provider "ultralock") are compiled in when <sys/sdt.h> is available (systemtap-sdt-dev).
+// Each probe is a single nop until perf/bpftrace attaches; build with -DULTRALOCK_NO_USDT to leave them out.
+#if !defined(ULTRALOCK_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define UL_PROBE(name, a, b) DTRACE_PROBE2(ultralock, name, a, b)
+#endif
+#endif
+#ifndef UL_PROBE
+#define UL_PROBE(name, a, b) do { (void)(a); (void)(b); } while (0)
+#endif
+
+// Flight recorder: per-thread rings holding the last FR_EVENTS trace events, dumped on SIGUSR1 or when the
+// watchdog sees the event loop stall. Only the owning thread writes its ring; readers validate each slot's seq.
+#define FR_EVENTS 1024
+#define FR_MAX_THREADS 64
+#define WATCHDOG_MS 3000
+struct fr_event { _Atomic uint64_t seq; uint64_t ts_ns; const char *name; long long arg; };
+struct fr_ring { pid_t tid; _Atomic uint64_t head; struct fr_event ev[FR_EVENTS]; };
+static struct fr_ring *_Atomic fr_rings[FR_MAX_THREADS];
+static atomic_int fr_nrings;
+static _Thread_local struct fr_ring *fr_self;
+static struct fr_ring fr_overflow; // threads beyond FR_MAX_THREADS record here and are not dumped
+static char flight_path[1024];
 
-// IPC binds store
-#define MAX_BINDS 256
-struct bind_entry { char fp[65]; long ts; };
+static void fr_record(const char *name, long long arg) {
+    struct fr_ring *r = fr_self;
+    if (!r) {
+        int n = atomic_fetch_add(&fr_nrings, 1);
+        r = n < FR_MAX_THREADS ? calloc(1, sizeof(*r)) : NULL;
+        if (r) { r->tid = gettid(); atomic_store(&fr_rings[n], r); } else r = &fr_overflow;
+        fr_self = r;
+    }
+    uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct fr_event *e = &r->ev[h % FR_EVENTS];
+    // seq 0 marks the slot as being rewritten while the fields change
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);
+    e->ts_ns = (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec; e->name = name; e->arg = arg;
+    atomic_store_explicit(&e->seq, h + 1, memory_order_release);
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+// Fire the USDT probe and record the event; b is the value kept in the flight recorder
+#define UL_TRACE(name, a, b) do { UL_PROBE(name, a, b); fr_record(#name, (long long)(b)); } while (0)
+
+struct fr_dump_entry { uint64_t ts_ns; pid_t tid; const char *name; long long arg; };
+static int fr_cmp(const void *a, const void *b) {
+    const struct fr_dump_entry *x = a, *y = b;
+    return x->ts_ns < y->ts_ns ? -1 : x->ts_ns > y->ts_ns;
+}
+
+// Snapshot every ring (safe against concurrent writers) and write the events in time order to flight_path
+static void fr_dump(const char *reason) {
+    int nr = atomic_load(&fr_nrings); if (nr > FR_MAX_THREADS) nr = FR_MAX_THREADS;
+    struct fr_dump_entry *all = malloc(sizeof(*all) * FR_EVENTS * (nr ? nr : 1)); size_t n = 0;
+    if (!all) return;
+    for (int i=0;i<nr;i++) {
+        struct fr_ring *r = atomic_load(&fr_rings[i]); if (!r) continue;
+        uint64_t h = atomic_load_explicit(&r->head, memory_order_acquire);
+        for (uint64_t k = h > FR_EVENTS ? h - FR_EVENTS : 0; k < h; k++) {
+            struct fr_event *e = &r->ev[k % FR_EVENTS];
+            uint64_t s1 = atomic_load_explicit(&e->seq, memory_order_acquire);
+            struct fr_dump_entry d = { e->ts_ns, r->tid, e->name, e->arg };
+            atomic_thread_fence(memory_order_acquire);
+            if (s1 != k + 1 || atomic_load_explicit(&e->seq, memory_order_relaxed) != s1) continue; // overwritten meanwhile
+            all[n++] = d;
+        }
+    }
+    qsort(all, n, sizeof(*all), fr_cmp);
+    char tmp[1100]; snprintf(tmp, sizeof(tmp), "%s.tmp", flight_path);
+    FILE *f = NULL; int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0) f = fdopen(fd, "w");
+    if (!f) { if (fd >= 0) close(fd); free(all); return; }
+    fprintf(f, "# ultralock flight recorder pid %d reason %s time %ld events %zu\n# mono_ns tid event arg\n", getpid(), reason, (long)time(NULL), n);
+    for (size_t i=0;i<n;i++) fprintf(f, "%llu %d %s %lld\n", (unsigned long long)all[i].ts_ns, all[i].tid, all[i].name, all[i].arg);
+    fclose(f); rename(tmp, flight_path); free(all);
+    printf("[FR] flight recorder (%s) dumped to %s\n", reason, flight_path);
+}
+
+// Watchdog thread: owns SIGUSR1 and dumps the flight recorder when the event loop heartbeat goes stale
+static _Atomic long long loop_heartbeat_ms;
+static void *watchdog_main(void *arg) {
+    (void)arg;
+    sigset_t all; sigfillset(&all); pthread_sigmask(SIG_BLOCK, &all, NULL);
+    sigset_t usr1; sigemptyset(&usr1); sigaddset(&usr1, SIGUSR1);
+    int stalled = 0;
+    while (1) {
+        struct timespec to = { 0, 250 * 1000000 };
+        if (sigtimedwait(&usr1, NULL, &to) == SIGUSR1) fr_dump("sigusr1");
+        struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t);
+        long long idle = (long long)t.tv_sec * 1000 + t.tv_nsec / 1000000 - atomic_load(&loop_heartbeat_ms);
+        if (idle > WATCHDOG_MS && !stalled) { stalled = 1; fprintf(stderr, "[WATCHDOG] event loop stalled for %lld ms\n", idle); fr_dump("stall"); }
+        else if (idle <= WATCHDOG_MS) stalled = 0;
+    }
+    return NULL;
+}
 
 // Simple helper to read/write a file with restricted permissions
 char *read_or_create_device_salt() {
@@ -158,7 +350,8 @@ char *read_or_create_device_salt() {
 
 
 // Very conservative canonicalization: remove whitespace and some invisibles, lowercase for bech32/ln
-void canonicalize(char *s) {
+// Untraced; bulk scan workers use it directly so they stay out of the flight recorder
+static void canonicalize_raw(char *s) {
     char out[MAX_CLIP]; int j=0; size_t sl = strlen(s);
     for (size_t i=0;i<sl && j < MAX_CLIP-1; i++) {
         unsigned char c = s[i];
@@ -176,150 +369,1382 @@ void canonicalize(char *s) {
     strncpy(s, out, MAX_CLIP);
 }
 
-// Helper: test whether a given clipboard text would be allowed by current binds
-int check_clipboard_text(const char *text, char *out_reason, size_t out_sz, const char *device_salt, const char *session_nonce, struct bind_entry *binds) {
+void canonicalize(char *s) {
+    canonicalize_raw(s);
+    UL_TRACE(canonicalized, s, strlen(s));
+}
+
+// Agent state shared by the IPC handlers and every attached display
+static char *device_salt;
+static char session_nonce[33];
+static struct bind_ns *ns_table[NS_BUCKETS]; static size_t ns_count, bind_count;
+static struct uid_quota *uq_table[UQ_BUCKETS];
+static size_t ns_limit = NS_MAX_BINDS;
+static int binds_dirty;
+static char binds_path[1024];
+// Bind journal (<binds_path>.journal): mutations since the last snapshot, appended in order; pending lines wait in jbuf
+static char journal_path[1040]; static int journal_fd = -1, journal_lost;
+static size_t journal_lines; static char *jbuf; static size_t jlen, jcap;
+static int audit_fd = -1;
+static char audit_path[1024];
+static char prev_hash[65];
+static int srv_fd = -1;
+static volatile sig_atomic_t upgrade_requested; // SIGHUP or UPGRADE: hand over to a fresh exec of self_exe
+static char self_exe[PATH_MAX]; static char **self_argv;
+
+// IPC clients; uid comes from SO_PEERCRED and selects the caller's bind namespace
+struct ipc_client {
+    int fd; uid_t uid; int binary, dead;
+    char *in; size_t inlen; long long last_ms; // last read or write progress, for the idle timeout
+    struct outq out, late; // late: responses held back until the batch's audit fsync
+};
+static struct ipc_client *clients; static int n_clients; // grows on demand up to MAX_CLIENTS
+
+// One attached X display (user session). Clipboard content is checked against the binds of the display owner.
+struct xdisplay {
+    char name[64]; uid_t uid; int discovered, dropping;
+    Display *dpy; Window win;
+    Atom clip, utf8, prop, store, text;
+    char last_text[MAX_CLIP];
+    long long next_poll_ms, poll_sent_us;
+    unsigned long polls, changes, blocked;
+    long long lat_sum_us, lat_max_us;
+    long mem_kb;
+};
+static struct xdisplay *displays[MAX_DISPLAYS];
+static const char *wanted_displays[MAX_DISPLAYS]; static int n_wanted;
+static int discover_displays;
+static jmp_buf x_io_jmp;
+static volatile int x_cur = -1;
+
+static long long now_us(void) { struct timespec t; clock_gettime(CLOCK_MONOTONIC, &t); return (long long)t.tv_sec*1000000 + t.tv_nsec/1000; }
+
+// Resident set size of this process in KiB (used to attribute memory to each attached display)
+static long rss_kb(void) {
+    long pages = 0, resident = 0; FILE *f = fopen("/proc/self/statm", "r");
+    if (f) { if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0; fclose(f); }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// helper to append audit entries; the entry is written right away and made durable by audit_sync()
+static int audit_dirty;
+static const char *audit_last_op = "";
+static void audit_write_entry(const char *op, const char *detail) {
+    if (audit_fd < 0) return;
+    char ts[64]; time_t now = time(NULL); snprintf(ts, sizeof(ts), "%ld", now);
+    // compute hash = sha256(prev_hash||ts||op||detail)
+    char payload[4096]; snprintf(payload, sizeof(payload), "%s|%s|%s|%s", prev_hash, ts, op, detail);
+    char newh[65]; sha256_hex(payload, newh);
+    char out[8192]; snprintf(out, sizeof(out), "%s|%s|%s|%s\n", ts, op, detail, newh);
+    ssize_t w = write(audit_fd, out, strlen(out)); // ignoring errors
+    UL_TRACE(audit_write, op, w);
+    strncpy(prev_hash, newh, 65);
+    audit_dirty = 1; audit_last_op = op;
+}
+
+static void audit_sync(void) {
+    if (!audit_dirty || audit_fd < 0) return;
+    int rc = fsync(audit_fd); audit_dirty = 0;
+    UL_TRACE(audit_fsync, audit_last_op, rc);
+}
+
+static void append_audit(const char *op, const char *detail) { audit_write_entry(op, detail); audit_sync(); }
+
+// Recover the chain tail (hash of the last entry) from the audit log
+static void audit_recover_tail(void) {
+    FILE *af = fopen(audit_path, "r"); if (!af) return;
+    char line[4096]; char lastline[4096] = {0};
+    while (fgets(line, sizeof(line), af)) { strncpy(lastline, line, sizeof(lastline)); }
+    fclose(af);
+    // extract last hash (after last '|')
+    char *p = strrchr(lastline, '|'); if (p) { p++; size_t l = strlen(p); while (l && (p[l-1]=='\n' || p[l-1]=='\r')) { p[--l]='\0'; } strncpy(prev_hash, p, 65); }
+}
+
+static void hex_encode(const unsigned char *in, size_t n, char *out) {
+    static const char hx[] = "0123456789abcdef";
+    for (size_t i=0;i<n;i++) { out[i*2] = hx[in[i] >> 4]; out[i*2+1] = hx[in[i] & 15]; }
+    out[n*2] = '\0';
+}
+
+static int hex_decode(const char *in, unsigned char *out, size_t n) {
+    if (strlen(in) != n*2) return 0;
+    for (size_t i=0;i<n*2;i++) {
+        char ch = in[i]; int v = (ch >= '0' && ch <= '9') ? ch - '0' : (ch >= 'a' && ch <= 'f') ? ch - 'a' + 10 : (ch >= 'A' && ch <= 'F') ? ch - 'A' + 10 : -1;
+        if (v < 0) return 0;
+        if (i & 1) out[i/2] |= v; else out[i/2] = v << 4;
+    }
+    return 1;
+}
+
+static size_t ns_hash(uid_t uid, const char *origin) {
+    uint64_t h = 1469598103934665603ull ^ uid; // FNV-1a over uid and origin
+    for (const unsigned char *p = (const unsigned char*)origin; *p; p++) { h ^= *p; h *= 1099511628211ull; }
+    return (size_t)(h & (NS_BUCKETS - 1));
+}
+
+static struct uid_quota *uid_quota(uid_t uid, int create) {
+    struct uid_quota **pp = &uq_table[uid & (UQ_BUCKETS - 1)];
+    for (struct uid_quota *q = *pp; q; q = q->next) if (q->uid == uid) return q;
+    if (!create) return NULL;
+    struct uid_quota *q = calloc(1, sizeof(*q)); if (!q) return NULL;
+    q->uid = uid; q->next = *pp; *pp = q;
+    return q;
+}
+
+// Namespace (shard) of uid + origin; created on demand when create is set
+static struct bind_ns *find_ns(uid_t uid, const char *origin, int create) {
+    size_t h = ns_hash(uid, origin);
+    for (struct bind_ns *ns = ns_table[h]; ns; ns = ns->next) if (ns->uid == uid && strcmp(ns->origin, origin) == 0) return ns;
+    if (!create) return NULL;
+    struct uid_quota *q = uid_quota(uid, 1); if (!q) return NULL;
+    struct bind_ns *ns = calloc(1, sizeof(*ns)); if (!ns) return NULL;
+    ns->uid = uid; snprintf(ns->origin, sizeof(ns->origin), "%s", origin); ns->limit = ns_limit; ns->quota = q;
+    ns->next = ns_table[h]; ns_table[h] = ns; ns_count++; q->ns++;
+    if ((ns->unext = q->list)) q->list->uprev = &ns->unext;
+    q->list = ns; ns->uprev = &q->list;
+    return ns;
+}
+
+// Drop a whole namespace: unlink the shard and free its table, independent of how many binds it holds
+static void drop_ns(struct bind_ns *ns) {
+    struct bind_ns **pp = &ns_table[ns_hash(ns->uid, ns->origin)];
+    while (*pp != ns) pp = &(*pp)->next;
+    *pp = ns->next; ns_count--; bind_count -= ns->count; ns->quota->ns--; ns->quota->binds -= ns->count;
+    if ((*ns->uprev = ns->unext)) ns->unext->uprev = ns->uprev;
+    free(ns->slots); free(ns);
+}
+
+static size_t bind_hash(const struct bind_ns *ns, const unsigned char fp[32]) {
+    uint64_t h; memcpy(&h, fp, sizeof(h)); // digests are uniformly distributed already
+    return (size_t)(h & (ns->cap - 1));
+}
+
+// Plain lookup without stats or tracing, safe for concurrent readers (bulk scan workers)
+static struct bind_entry *probe_bind(const struct bind_ns *ns, const unsigned char fp[32]) {
+    if (ns && ns->cap) for (size_t i = bind_hash(ns, fp); ns->slots[i].used; i = (i + 1) & (ns->cap - 1))
+        if (memcmp(ns->slots[i].fp, fp, 32) == 0) return &ns->slots[i];
+    return NULL;
+}
+
+static struct bind_entry *find_bind(struct bind_ns *ns, const unsigned char fp[32]) {
+    struct bind_entry *found = probe_bind(ns, fp);
+    if (ns) { ns->lookups++; if (found) ns->hits++; }
+    UL_TRACE(bind_lookup, fp, found ? (long long)(found - ns->slots) : -1);
+    return found;
+}
+
+static int grow_binds(struct bind_ns *ns) {
+    size_t ocap = ns->cap, ncap = ns->cap ? ns->cap * 2 : 16;
+    struct bind_entry *old = ns->slots, *nb = calloc(ncap, sizeof(*nb));
+    if (!nb) return 0;
+    ns->slots = nb; ns->cap = ncap;
+    for (size_t i=0;i<ocap;i++) if (old[i].used) {
+        size_t j = bind_hash(ns, old[i].fp); while (nb[j].used) j = (j + 1) & (ncap - 1);
+        nb[j] = old[i];
+    }
+    free(old);
+    return 1;
+}
+
+// Binding an already bound fingerprint refreshes its timestamp; NULL when the namespace or the agent is full.
+// The limits only gate new binds (limited); binds already persisted are restored past them rather than lost.
+static struct bind_entry *insert_bind(struct bind_ns *ns, const unsigned char fp[32], int limited) {
+    if (!ns) return NULL;
+    struct bind_entry *e = find_bind(ns, fp);
+    if (!e) {
+        if (limited && (ns->count >= ns->limit || ns->quota->binds >= UID_MAX_BINDS || bind_count >= MAX_BINDS)) return NULL;
+        if ((ns->count + 1) * 4 > ns->cap * 3 && !grow_binds(ns)) return NULL;
+        size_t i = bind_hash(ns, fp); while (ns->slots[i].used) i = (i + 1) & (ns->cap - 1);
+        e = &ns->slots[i]; memcpy(e->fp, fp, 32); e->used = 1; ns->count++; ns->quota->binds++; bind_count++;
+    }
+    e->ts = time(NULL);
+    return e;
+}
+
+static struct bind_entry *store_bind(struct bind_ns *ns, const unsigned char fp[32]) { return insert_bind(ns, fp, 1); }
+
+// Journal one mutation: '+' bind (fp, ts), '-' unbind (fp), 'D' drop the namespace. Origin is the last column.
+// A line that cannot be buffered makes the next flush rewrite the snapshot instead.
+static void journal_put(char op, const struct bind_ns *ns, const unsigned char *fp, long ts) {
+    char line[MAX_ORIGIN + 128], hex[65] = ""; int n;
+    if (fp) hex_encode(fp, 32, hex);
+    if (op == '+') n = snprintf(line, sizeof(line), "+ %s %ld %u %s\n", hex, ts, (unsigned)ns->uid, ns->origin);
+    else if (op == '-') n = snprintf(line, sizeof(line), "- %s %u %s\n", hex, (unsigned)ns->uid, ns->origin);
+    else n = snprintf(line, sizeof(line), "D %u %s\n", (unsigned)ns->uid, ns->origin);
+    if (jlen + n > jcap) {
+        size_t nc = jcap ? jcap * 2 : 4096; while (nc < jlen + n) nc *= 2;
+        char *b = realloc(jbuf, nc); if (!b) { journal_lost = 1; return; }
+        jbuf = b; jcap = nc;
+    }
+    memcpy(jbuf + jlen, line, n); jlen += n; journal_lines++;
+    if (jlen > JOURNAL_BUF) binds_dirty = 1;
+}
+
+// New bind of uid in origin, journaled. A namespace is only created when the bind fits the user's and the agent's
+// limits, so refused binds do not leave empty namespaces behind. Restored binds use insert_bind directly.
+static struct bind_entry *bind_fp(uid_t uid, const char *origin, const unsigned char fp[32]) {
+    struct bind_ns *ns = find_ns(uid, origin, 0); struct bind_entry *e;
+    if (ns) e = store_bind(ns, fp);
+    else {
+        struct uid_quota *q = uid_quota(uid, 1);
+        if (!q || q->ns >= UID_MAX_NS || q->binds >= UID_MAX_BINDS || bind_count >= MAX_BINDS || !ns_limit) return NULL;
+        e = store_bind(ns = find_ns(uid, origin, 1), fp);
+        if (!e && ns) drop_ns(ns);
+    }
+    if (e) journal_put('+', ns, fp, e->ts);
+    return e;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+static void remove_bind(struct bind_ns *ns, struct bind_entry *e) {
+    size_t i = e - ns->slots, j = i;
+    ns->slots[i].used = 0; ns->count--; ns->quota->binds--; bind_count--;
+    while (1) {
+        j = (j + 1) & (ns->cap - 1);
+        if (!ns->slots[j].used) break;
+        size_t k = bind_hash(ns, ns->slots[j].fp);
+        int stays = i < j ? (k > i && k <= j) : (k > i || k <= j);
+        if (!stays) { ns->slots[i] = ns->slots[j]; ns->slots[j].used = 0; i = j; }
+    }
+}
+
+static void unbind_entry(struct bind_ns *ns, struct bind_entry *e) { journal_put('-', ns, e->fp, 0); remove_bind(ns, e); }
+static void drop_origin(struct bind_ns *ns) { journal_put('D', ns, NULL, 0); drop_ns(ns); }
+
+// helper to persist binds atomically; origin is the last column since it may contain spaces. The snapshot holds
+// everything, so the journal starts over.
+static void save_binds() {
+    char tmp[1024]; snprintf(tmp, sizeof(tmp), "%s.tmp", binds_path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) { append_audit("save-binds-fail", "open"); return; }
+    FILE *f = fdopen(fd, "w"); if (!f) { close(fd); append_audit("save-binds-fail", "open"); return; }
+    for (size_t h=0;h<NS_BUCKETS;h++) for (struct bind_ns *ns = ns_table[h]; ns; ns = ns->next)
+        for (size_t i=0;i<ns->cap;i++) if (ns->slots[i].used) {
+            char hex[65]; hex_encode(ns->slots[i].fp, 32, hex);
+            fprintf(f, "%s %ld %u %s\n", hex, ns->slots[i].ts, (unsigned)ns->uid, ns->origin);
+        }
+    fflush(f); fsync(fd); fclose(f);
+    if (rename(tmp, binds_path) < 0) { journal_lost = 1; append_audit("save-binds-fail", "rename"); return; }
+    if (journal_fd >= 0 && ftruncate(journal_fd, 0) < 0) { journal_lost = 1; return; }
+    jlen = 0; journal_lines = 0; journal_lost = 0;
+    append_audit("save-binds", binds_path);
+}
+
+// Make the binds durable: append the pending journal lines with one fdatasync, or rewrite the snapshot once the
+// journal outgrows the store, so a bind costs O(1) amortized instead of a full rewrite
+static void flush_binds(void) {
+    if (journal_lost || journal_fd < 0 || journal_lines > JOURNAL_MIN + bind_count) { save_binds(); return; }
+    for (size_t off = 0; off < jlen; ) {
+        ssize_t w = write(journal_fd, jbuf + off, jlen - off);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) { save_binds(); return; }
+        off += w;
+    }
+    if (jlen) fdatasync(journal_fd);
+    jlen = 0;
+}
+
+// Replay the journal over the loaded snapshot. Only complete lines count: a torn last line is from a crash
+// mid-append, before that batch was answered. Replaying onto a newer snapshot is harmless (same end state).
+static void replay_journal(void) {
+    FILE *f = fopen(journal_path, "r"); if (!f) return;
+    char line[MAX_ORIGIN + 128]; while (fgets(line, sizeof(line), f) && strchr(line, '\n')) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char hex[65]; long ts; unsigned uid; unsigned char fp[32]; int off = 0; struct bind_ns *ns; struct bind_entry *e;
+        if (line[0] == '+' && sscanf(line + 1, " %64s %ld %u %n", hex, &ts, &uid, &off) == 3 && off && hex_decode(hex, fp, 32)) {
+            if ((e = insert_bind(find_ns(uid, line + 1 + off, 1), fp, 0))) e->ts = ts;
+        } else if (line[0] == '-' && sscanf(line + 1, " %64s %u %n", hex, &uid, &off) == 2 && off && hex_decode(hex, fp, 32)) {
+            if ((ns = find_ns(uid, line + 1 + off, 0)) && (e = probe_bind(ns, fp))) remove_bind(ns, e);
+        } else if (line[0] == 'D' && sscanf(line + 1, " %u %n", &uid, &off) == 1 && off) {
+            if ((ns = find_ns(uid, line + 1 + off, 0))) drop_ns(ns);
+        } else continue;
+        journal_lines++;
+    }
+    fclose(f);
+}
+
+static void open_journal(void) {
+    journal_fd = open(journal_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (journal_fd < 0) append_audit("journal-fail", "open");
+}
+
+// helper to load binds from persistence (older files lack the uid and origin columns: agent user, default origin)
+static void load_binds() {
+    FILE *f = fopen(binds_path, "r");
+    char line[512]; while (f && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char hex[65]; long ts; unsigned uid = getuid(); unsigned char fp[32]; int off = 0;
+        int n = sscanf(line, "%64s %ld %u %n", hex, &ts, &uid, &off);
+        if (n < 2 || !hex_decode(hex, fp, 32)) continue;
+        const char *origin = (n == 3 && off && line[off]) ? line + off : DEFAULT_ORIGIN;
+        struct bind_entry *e = insert_bind(find_ns(uid, origin, 1), fp, 0); if (!e) continue;
+        e->ts = ts;
+    }
+    if (f) fclose(f);
+    replay_journal();
+    append_audit("load-binds", f || journal_lines ? binds_path : "none");
+    // a lowered --ns-limit keeps what is stored and only refuses new binds there; record where that applies
+    for (size_t h=0;h<NS_BUCKETS;h++) for (struct bind_ns *ns = ns_table[h]; ns; ns = ns->next) if (ns->count > ns->limit) {
+        char detail[MAX_ORIGIN + 64]; snprintf(detail, sizeof(detail), "uid=%u origin=%s binds=%zu limit=%zu", (unsigned)ns->uid, ns->origin, ns->count, ns->limit);
+        append_audit("load-binds-over-limit", detail);
+    }
+}
+
+// Fingerprint of canonical text in an origin: the UltraLock.js composite with the bare origin as context (not its origin|userAgent|title)
+static void fingerprint_raw(const char *canonical, const char *origin, unsigned char fp[32]) {
+    char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", canonical, origin, device_salt, session_nonce);
+    sha256_raw(composite, fp);
+}
+
+static void fingerprint(const char *canonical, const char *origin, unsigned char fp[32]) {
+    fingerprint_raw(canonical, origin, fp);
+    UL_TRACE(fingerprinted, fp, strlen(canonical));
+}
+
+// Helper: test whether a given clipboard text would be allowed by the binds of uid. The clipboard carries no
+// origin, so the default namespace is checked first and then every other namespace of the user (its own list only).
+int check_clipboard_text(const char *text, char *out_reason, size_t out_sz, uid_t uid) {
     if (!text) return 1;
     char local[MAX_CLIP]; strncpy(local, text, MAX_CLIP); canonicalize(local);
     int is_addr = 0; if (strstr(local, "bc1") || strstr(local, "0x") || strstr(local, "lnbc")) is_addr = 1;
     if (!is_addr) return 1; // not an address, allow
-    char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", local, "local-origin", device_salt, session_nonce);
-    char fp[65]; sha256_hex(composite, fp);
-    for (int b=0;b<MAX_BINDS;b++) { if (binds[b].fp[0] && strcmp(binds[b].fp, fp)==0) return 1; }
+    unsigned char fp[32];
+    struct bind_ns *def = find_ns(uid, DEFAULT_ORIGIN, 0);
+    if (def) { fingerprint(local, DEFAULT_ORIGIN, fp); if (find_bind(def, fp)) return 1; }
+    struct uid_quota *q = uid_quota(uid, 0);
+    for (struct bind_ns *ns = q ? q->list : NULL; ns; ns = ns->unext) {
+        if (ns == def || !ns->count) continue;
+        fingerprint(local, ns->origin, fp); if (find_bind(ns, fp)) return 1;
+    }
     if (out_reason && out_sz>0) snprintf(out_reason, out_sz, "[UltraLock ALERT] Clipboard content appears to be a protected address; paste blocked by UltraLock.");
     return 0;
 }
 
+static int outq_put(struct outq *q, const void *p, size_t len) {
+    if (q->n) {
+        struct iovec *l = &q->v[q->n-1]; size_t fill = (char*)l->iov_base - q->base[q->n-1] + l->iov_len;
+        if (fill + len <= OUT_CHUNK) { memcpy(q->base[q->n-1] + fill, p, len); l->iov_len += len; return 1; }
+    }
+    if (q->n == OUT_MAX_CHUNKS) return 0;
+    char *b = malloc(len > OUT_CHUNK ? len : OUT_CHUNK); if (!b) return 0;
+    memcpy(b, p, len); q->base[q->n] = b; q->v[q->n].iov_base = b; q->v[q->n].iov_len = len; q->n++;
+    return 1;
+}
+
+static void outq_free(struct outq *q) { for (int i=0;i<q->n;i++) free(q->base[i]); q->n = 0; }
+
+// Move the chunks of src behind dst without copying; 0 if dst has no room left
+static int outq_splice(struct outq *dst, struct outq *src) {
+    int ok = 1;
+    for (int i=0;i<src->n;i++) {
+        if (dst->n < OUT_MAX_CHUNKS) { dst->base[dst->n] = src->base[i]; dst->v[dst->n] = src->v[i]; dst->n++; }
+        else { free(src->base[i]); ok = 0; }
+    }
+    src->n = 0;
+    return ok;
+}
+
+// Send as much of the queue as the socket takes, all chunks in one sendmsg(); 0 drained, 1 socket full, -1 error
+static int outq_flush(int fd, struct outq *q) {
+    while (q->n) {
+        struct msghdr m; memset(&m, 0, sizeof(m)); m.msg_iov = q->v; m.msg_iovlen = q->n < IOV_MAX ? q->n : IOV_MAX;
+        ssize_t w = sendmsg(fd, &m, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (w < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : errno == EINTR ? 0 : -1;
+        int k = 0; while (k < q->n && (size_t)w >= q->v[k].iov_len) { w -= q->v[k].iov_len; free(q->base[k]); k++; }
+        if (k < q->n && w) { q->v[k].iov_base = (char*)q->v[k].iov_base + w; q->v[k].iov_len -= w; }
+        memmove(q->v, q->v + k, sizeof(q->v[0]) * (q->n - k)); memmove(q->base, q->base + k, sizeof(q->base[0]) * (q->n - k));
+        q->n -= k;
+    }
+    return 0;
+}
+
+static void ipc_close(struct ipc_client *c) {
+    close(c->fd); c->fd = -1;
+    free(c->in); c->in = NULL; c->inlen = 0;
+    outq_free(&c->out); outq_free(&c->late);
+}
+
+static void ipc_put(struct ipc_client *c, struct outq *q, const void *p, size_t len) { if (!outq_put(q, p, len)) c->dead = 1; }
+static void ipc_reply(struct ipc_client *c, const char *s) { ipc_put(c, &c->out, s, strlen(s)); }
+
+static void put32(unsigned char *p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static uint32_t get32(const unsigned char *p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+
+static void bin_reply(struct ipc_client *c, struct outq *q, int op, int status, int flags, uint32_t id, const void *payload, size_t plen) {
+    unsigned char h[BIN_HDR]; put32(h, plen); h[4] = op; h[5] = status; h[6] = flags >> 8; h[7] = flags; put32(h + 8, id);
+    ipc_put(c, q, h, BIN_HDR);
+    if (plen) ipc_put(c, q, payload, plen);
+}
+
+// Address argument shared by BINDADDR/UNBINDADDR/VERIFYADDR: strict validation, then canonicalize into out
+static int canonical_addr(const char *addr, size_t len, int strict, char out[MAX_CLIP]) {
+    if (len == 0 || len >= MAX_CLIP) return 0;
+    // strict input validation: sane length and printable, no CR/LF
+    if (strict && (len < 10 || len > 512)) return 0;
+    for (size_t i=0;i<len;i++) { unsigned char ch = addr[i]; if (ch == 0 || (strict && ch <= 32)) return 0; }
+    memcpy(out, addr, len); out[len] = '\0'; canonicalize(out);
+    // the canonical form goes into the shared audit log in every mode: no '|' (field separator) or control bytes
+    for (const unsigned char *q = (const unsigned char*)out; *q; q++) if (*q == '|' || *q < 32 || *q == 127) { out[0] = '\0'; return 0; }
+    return 1;
+}
+
+// Origins are printable ASCII without '|' (the audit log separator); spaces are allowed for execution contexts
+static int valid_origin(const char *o) {
+    size_t n = strlen(o);
+    if (n == 0 || n >= MAX_ORIGIN) return 0;
+    for (size_t i=0;i<n;i++) if (o[i] < 32 || o[i] > 126 || o[i] == '|') return 0;
+    return 1;
+}
+
+// Split an optional trailing " ORIGIN <o>" off a text command; NULL if the origin is malformed
+static const char *split_origin(char *args) {
+    char *o = strstr(args, " ORIGIN ");
+    if (!o) return DEFAULT_ORIGIN;
+    *o = '\0'; o += 8;
+    return valid_origin(o) ? o : NULL;
+}
+
+// Audit detail: the canonical address, tagged with its origin outside the default namespace
+static const char *audit_detail(char *buf, size_t sz, const char *canonical, const char *origin) {
+    if (strcmp(origin, DEFAULT_ORIGIN) == 0) return canonical;
+    snprintf(buf, sz, "%s origin=%s", canonical, origin);
+    return buf;
+}
+
+// Handle one text protocol line from an IPC client
+static void handle_ipc_line(struct ipc_client *c, char *line) {
+    unsigned char fp[32]; char canonical[MAX_CLIP]; char detail[MAX_CLIP + MAX_ORIGIN + 16]; const char *origin;
+    if (strncmp(line, "BIND ", 5) == 0) {
+        if (!(origin = split_origin(line + 5))) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        if (!hex_decode(line + 5, fp, 32)) ipc_reply(c, "ERR invalid-fp\n");
+        else ipc_reply(c, bind_fp(c->uid, origin, fp) ? "OK\n" : "ERR full\n");
+    } else if (strncmp(line, "BINDADDR ", 9) == 0) {
+        if (!(origin = split_origin(line + 9))) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        if (!canonical_addr(line + 9, strlen(line + 9), 1, canonical)) { ipc_reply(c, "ERR invalid-addr\n"); return; }
+        fingerprint(canonical, origin, fp);
+        if (bind_fp(c->uid, origin, fp)) { ipc_reply(c, "OK\n"); append_audit("bindaddr", audit_detail(detail, sizeof(detail), canonical, origin)); binds_dirty = 1; } else ipc_reply(c, "ERR full\n");
+    } else if (strncmp(line, "UNBIND ", 7) == 0) {
+        if (!(origin = split_origin(line + 7))) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        struct bind_ns *ns = find_ns(c->uid, origin, 0);
+        struct bind_entry *e = hex_decode(line + 7, fp, 32) ? find_bind(ns, fp) : NULL;
+        if (e) { unbind_entry(ns, e); ipc_reply(c, "OK\n"); binds_dirty = 1; append_audit("unbind", audit_detail(detail, sizeof(detail), line + 7, origin)); } else ipc_reply(c, "ERR notfound\n");
+    } else if (strncmp(line, "UNBINDADDR ", 11) == 0) {
+        if (!(origin = split_origin(line + 11))) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        if (!canonical_addr(line + 11, strlen(line + 11), 0, canonical)) { ipc_reply(c, "ERR invalid-addr\n"); return; }
+        fingerprint(canonical, origin, fp);
+        struct bind_ns *ns = find_ns(c->uid, origin, 0);
+        struct bind_entry *e = find_bind(ns, fp);
+        if (e) { unbind_entry(ns, e); ipc_reply(c, "OK\n"); append_audit("unbindaddr", audit_detail(detail, sizeof(detail), canonical, origin)); binds_dirty = 1; } else ipc_reply(c, "ERR notfound\n");
+    } else if (strncmp(line, "UNBINDORIGIN ", 13) == 0) {
+        // bulk unbind: drops the whole namespace at once
+        if (!valid_origin(line + 13)) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        struct bind_ns *ns = find_ns(c->uid, line + 13, 0);
+        if (ns) { drop_origin(ns); ipc_reply(c, "OK\n"); append_audit("unbind-origin", line + 13); binds_dirty = 1; } else ipc_reply(c, "ERR notfound\n");
+    } else if (strncmp(line, "LIST", 4) == 0 && (line[4] == '\0' || line[4] == ' ')) {
+        if (!(origin = split_origin(line)) || strcmp(line, "LIST") != 0) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        append_audit("list", "client-list");
+        struct bind_ns *ns = find_ns(c->uid, origin, 0);
+        for (size_t b=0; ns && b<ns->cap; b++) if (ns->slots[b].used) {
+            char hex[65]; hex_encode(ns->slots[b].fp, 32, hex);
+            char out[128]; int n = snprintf(out, sizeof(out), "FP %s %ld\n", hex, ns->slots[b].ts); ipc_put(c, &c->out, out, n);
+        }
+        ipc_reply(c, "END\n");
+    } else if (strcmp(line, "NAMESPACES") == 0) {
+        // per-namespace stats of the caller; origin goes last since it may contain spaces
+        struct uid_quota *q = uid_quota(c->uid, 0);
+        for (struct bind_ns *ns = q ? q->list : NULL; ns; ns = ns->unext) {
+            char out[MAX_ORIGIN + 128]; snprintf(out, sizeof(out), "NS binds %zu limit %zu lookups %lu hits %lu origin %s\n", ns->count, ns->limit, ns->lookups, ns->hits, ns->origin);
+            ipc_reply(c, out);
+        }
+        ipc_reply(c, "END\n");
+    } else if (strncmp(line, "VERIFY ", 7) == 0) {
+        // fingerprint lookup only: the caller already holds the fingerprint, so nothing is audited
+        if (!(origin = split_origin(line + 7))) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        if (!hex_decode(line + 7, fp, 32)) ipc_reply(c, "ERR invalid-fp\n");
+        else ipc_reply(c, find_bind(find_ns(c->uid, origin, 0), fp) ? "OK\n" : "ERR notbound\n");
+    } else if (strncmp(line, "VERIFYADDR ", 11) == 0) {
+        if (!(origin = split_origin(line + 11))) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        canonical[0] = '\0'; // an empty address is simply not bound
+        if (line[11] && !canonical_addr(line + 11, strlen(line + 11), 0, canonical)) { ipc_reply(c, "ERR invalid-addr\n"); return; }
+        fingerprint(canonical, origin, fp);
+        const char *d = audit_detail(detail, sizeof(detail), canonical, origin);
+        if (find_bind(find_ns(c->uid, origin, 0), fp)) { ipc_reply(c, "OK\n"); append_audit("verify", d); } else { ipc_reply(c, "ERR notbound\n"); append_audit("verify-failed", d); }
+    } else if (strncmp(line, "SCANSET", 7) == 0 && (line[7] == '\0' || line[7] == ' ')) {
+        // bulk scan (clipwatch --scan) fingerprints locally, so it gets the salts and the namespace's fingerprints;
+        // not audited itself, the scanner reports one summary with SCANDONE
+        if (!(origin = split_origin(line)) || strcmp(line, "SCANSET") != 0) { ipc_reply(c, "ERR invalid-origin\n"); return; }
+        if (c->uid != getuid() && c->uid != 0) { ipc_reply(c, "ERR denied\n"); return; }
+        char out[256]; snprintf(out, sizeof(out), "KEY %s %s\n", device_salt, session_nonce); ipc_reply(c, out);
+        struct bind_ns *ns = find_ns(c->uid, origin, 0);
+        for (size_t b=0; ns && b<ns->cap; b++) if (ns->slots[b].used) {
+            char hex[65]; hex_encode(ns->slots[b].fp, 32, hex);
+            int n = snprintf(out, sizeof(out), "FP %s\n", hex); ipc_put(c, &c->out, out, n);
+        }
+        ipc_reply(c, "END\n");
+    } else if (strncmp(line, "SCANDONE ", 9) == 0) {
+        const char *d = line + 9; int ok = *d && strlen(d) < 1024 && (c->uid == getuid() || c->uid == 0);
+        for (const char *q = d; ok && *q; q++) if (*q < 32 || *q > 126 || *q == '|') ok = 0;
+        if (ok) { append_audit("scan", d); ipc_reply(c, "OK\n"); } else ipc_reply(c, "ERR invalid\n");
+    } else if (strcmp(line, "UPGRADE") == 0) {
+        // live upgrade to the binary on disk; on a shared socket only the agent user (or root) may ask
+        if (c->uid != getuid() && c->uid != 0) ipc_reply(c, "ERR denied\n");
+        else { upgrade_requested = 1; ipc_reply(c, "OK upgrading\n"); }
+    } else if (strcmp(line, "BINARY") == 0) {
+        c->binary = 1; ipc_reply(c, "OK BINARY\n");
+    } else if (strcmp(line, "DISPLAYS") == 0) {
+        // per-display enforcement stats; users only see their own sessions
+        for (int i=0;i<MAX_DISPLAYS;i++) {
+            struct xdisplay *d = displays[i]; if (!d || (c->uid != 0 && c->uid != d->uid)) continue;
+            char out[256]; snprintf(out, sizeof(out), "DPY %s uid %u polls %lu changes %lu blocked %lu lat_avg_us %lld lat_max_us %lld mem_kb %ld\n",
+                d->name, (unsigned)d->uid, d->polls, d->changes, d->blocked, d->changes ? d->lat_sum_us / (long long)d->changes : 0, d->lat_max_us, d->mem_kb);
+            ipc_reply(c, out);
+        }
+        char out[64]; snprintf(out, sizeof(out), "RSS %ld\nEND\n", rss_kb()); ipc_reply(c, out);
+    } else {
+        ipc_reply(c, "ERR unknown\n");
+    }
+}
+
+// Handle one binary frame. Commands that append to the audit log answer on the late queue, which is only
+// released after the single audit fsync of this batch; everything else answers immediately.
+// With FL_ORIGIN the payload starts with u8 origin length + origin, selecting the namespace.
+static void handle_bin_frame(struct ipc_client *c, int op, int flags, uint32_t id, const unsigned char *p, uint32_t plen) {
+    char canonical[MAX_CLIP]; char detail[MAX_CLIP + MAX_ORIGIN + 16]; unsigned char fp[32]; struct bind_entry *e;
+    char obuf[MAX_ORIGIN]; const char *origin = DEFAULT_ORIGIN; struct bind_ns *ns;
+    if (flags & FL_ORIGIN) {
+        if (plen < 1 || plen < 1u + p[0]) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); return; }
+        memcpy(obuf, p + 1, p[0]); obuf[p[0]] = '\0';
+        if (!valid_origin(obuf)) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); return; }
+        origin = obuf; plen -= 1 + p[0]; p += 1 + p[0];
+    }
+    switch (op) {
+    case OP_BIND:
+        if (plen != 32) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); break; }
+        bin_reply(c, &c->out, op, bind_fp(c->uid, origin, p) ? ST_OK : ST_FULL, 0, id, NULL, 0);
+        break;
+    case OP_VERIFY:
+        if (plen != 32) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); break; }
+        bin_reply(c, &c->out, op, find_bind(find_ns(c->uid, origin, 0), p) ? ST_OK : ST_NOTBOUND, 0, id, NULL, 0);
+        break;
+    case OP_UNBIND:
+        if (plen != 32) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); break; }
+        ns = find_ns(c->uid, origin, 0);
+        if (!(e = find_bind(ns, p))) { bin_reply(c, &c->out, op, ST_NOTFOUND, 0, id, NULL, 0); break; }
+        unbind_entry(ns, e); binds_dirty = 1;
+        { char hex[65]; hex_encode(p, 32, hex); audit_write_entry("unbind", audit_detail(detail, sizeof(detail), hex, origin)); }
+        bin_reply(c, &c->late, op, ST_OK, 0, id, NULL, 0);
+        break;
+    case OP_UNBINDORIGIN:
+        if (!(flags & FL_ORIGIN) || plen) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); break; }
+        if (!(ns = find_ns(c->uid, origin, 0))) { bin_reply(c, &c->out, op, ST_NOTFOUND, 0, id, NULL, 0); break; }
+        drop_origin(ns); binds_dirty = 1; audit_write_entry("unbind-origin", origin);
+        bin_reply(c, &c->late, op, ST_OK, 0, id, NULL, 0);
+        break;
+    case OP_BINDADDR:
+    case OP_UNBINDADDR:
+    case OP_VERIFYADDR:
+        if (!canonical_addr((const char*)p, plen, op == OP_BINDADDR, canonical)) { bin_reply(c, &c->out, op, ST_INVALID, 0, id, NULL, 0); break; }
+        fingerprint(canonical, origin, fp);
+        audit_detail(detail, sizeof(detail), canonical, origin);
+        ns = find_ns(c->uid, origin, 0);
+        if (op == OP_BINDADDR) {
+            if (!bind_fp(c->uid, origin, fp)) { bin_reply(c, &c->out, op, ST_FULL, 0, id, NULL, 0); break; }
+            binds_dirty = 1; audit_write_entry("bindaddr", audit_detail(detail, sizeof(detail), canonical, origin));
+            bin_reply(c, &c->late, op, ST_OK, 0, id, fp, 32);
+        } else if (op == OP_UNBINDADDR) {
+            if (!(e = find_bind(ns, fp))) { bin_reply(c, &c->out, op, ST_NOTFOUND, 0, id, NULL, 0); break; }
+            unbind_entry(ns, e); binds_dirty = 1; audit_write_entry("unbindaddr", audit_detail(detail, sizeof(detail), canonical, origin));
+            bin_reply(c, &c->late, op, ST_OK, 0, id, fp, 32);
+        } else {
+            int ok = find_bind(ns, fp) != NULL;
+            audit_write_entry(ok ? "verify" : "verify-failed", audit_detail(detail, sizeof(detail), canonical, origin));
+            bin_reply(c, &c->late, op, ok ? ST_OK : ST_NOTBOUND, 0, id, fp, 32);
+        }
+        break;
+    case OP_LIST: {
+        // entries are raw digest + big-endian 64-bit timestamp, LIST_BATCH per frame; FL_MORE on all but the last frame
+        static unsigned char batch[LIST_BATCH * 40]; int n = 0;
+        audit_write_entry("list", "client-list");
+        ns = find_ns(c->uid, origin, 0);
+        for (size_t b=0; ns && b<ns->cap; b++) if (ns->slots[b].used) {
+            if (n == LIST_BATCH) { bin_reply(c, &c->late, op, ST_OK, FL_MORE, id, batch, sizeof(batch)); n = 0; }
+            unsigned char *x = batch + n * 40; memcpy(x, ns->slots[b].fp, 32);
+            uint64_t ts = (uint64_t)ns->slots[b].ts; put32(x + 32, ts >> 32); put32(x + 36, (uint32_t)ts); n++;
+        }
+        bin_reply(c, &c->late, op, ST_OK, 0, id, batch, n * 40);
+        break;
+    }
+    default:
+        bin_reply(c, &c->out, op, ST_UNKNOWN, 0, id, NULL, 0);
+    }
+}
+
+// Free client slot, growing the table when all are taken; NULL at MAX_CLIENTS or out of memory
+static struct ipc_client *ipc_slot(void) {
+    for (int i=0;i<n_clients;i++) if (clients[i].fd < 0) return &clients[i];
+    if (n_clients >= MAX_CLIENTS) return NULL;
+    int n = n_clients ? n_clients * 2 : 8; if (n > MAX_CLIENTS) n = MAX_CLIENTS;
+    struct ipc_client *nc = realloc(clients, n * sizeof(*nc)); if (!nc) return NULL;
+    memset(nc + n_clients, 0, (n - n_clients) * sizeof(*nc));
+    for (int i=n_clients;i<n;i++) nc[i].fd = -1;
+    clients = nc; struct ipc_client *c = &clients[n_clients]; n_clients = n;
+    return c;
+}
+
+static void ipc_accept(void) {
+    int c = accept(srv_fd, NULL, NULL);
+    if (c < 0) return;
+    struct ucred cred; socklen_t cl = sizeof(cred); uid_t uid = getuid();
+    if (getsockopt(c, SOL_SOCKET, SO_PEERCRED, &cred, &cl) == 0) uid = cred.uid;
+    int per_uid = 0; for (int i=0;i<n_clients;i++) if (clients[i].fd >= 0 && clients[i].uid == uid) per_uid++;
+    if (c >= FD_SETSIZE || per_uid >= MAX_CLIENTS_PER_UID) { send(c, "ERR busy\n", 9, MSG_NOSIGNAL | MSG_DONTWAIT); close(c); return; }
+    struct ipc_client *cl2 = ipc_slot(); char *in = cl2 ? malloc(IPC_BUF) : NULL;
+    if (!in) { send(c, "ERR busy\n", 9, MSG_NOSIGNAL | MSG_DONTWAIT); close(c); return; }
+    cl2->fd = c; cl2->uid = uid; cl2->in = in; cl2->inlen = 0; cl2->binary = 0; cl2->dead = 0; cl2->last_ms = now_us() / 1000;
+    printf("[IPC] client connected\n");
+}
+
+static void ipc_flush(struct ipc_client *c) {
+    int n0 = c->out.n, r = outq_flush(c->fd, &c->out);
+    if (r < 0 || (r == 0 && c->dead)) { ipc_close(c); return; }
+    if (r == 0 || c->out.n < n0) c->last_ms = now_us() / 1000;
+}
+
+// Binary opcodes by their text verb, so traces of both protocols aggregate under the same name
+static const char *const bin_op_names[] = { "?", "BIND", "UNBIND", "VERIFY", "BINDADDR", "UNBINDADDR", "VERIFYADDR", "LIST", "UNBINDORIGIN" };
+
+static void ipc_service(struct ipc_client *c) {
+    ssize_t r = recv(c->fd, c->in + c->inlen, IPC_BUF - c->inlen, 0);
+    if (r <= 0) { ipc_close(c); return; }
+    c->inlen += r; c->last_ms = now_us() / 1000;
+    size_t pos = 0;
+    while (pos < c->inlen && !c->dead) {
+        if (c->binary) {
+            const unsigned char *h = (const unsigned char*)c->in + pos;
+            if (c->inlen - pos < BIN_HDR) break;
+            uint32_t plen = get32(h);
+            if (plen > BIN_MAX_PAYLOAD) { bin_reply(c, &c->out, h[4], ST_INVALID, 0, get32(h + 8), NULL, 0); c->dead = 1; break; }
+            if (c->inlen - pos < BIN_HDR + plen) break;
+            const char *verb = h[4] < sizeof(bin_op_names) / sizeof(*bin_op_names) ? bin_op_names[h[4]] : "?";
+            UL_TRACE(ipc_start, verb, c->fd);
+            handle_bin_frame(c, h[4], h[6] << 8 | h[7], get32(h + 8), h + BIN_HDR, plen);
+            UL_TRACE(ipc_end, verb, c->fd);
+            pos += BIN_HDR + plen;
+        } else {
+            // simple line handling: split on newlines
+            char *nl = memchr(c->in + pos, '\n', c->inlen - pos);
+            if (!nl) break;
+            *nl = '\0'; char *line = c->in + pos; pos = nl - c->in + 1;
+            size_t ll = strlen(line); while (ll && line[ll-1] == '\r') line[--ll] = '\0';
+            if (!ll) continue;
+            char verb[16]; size_t vl = strcspn(line, " "); if (vl >= sizeof(verb)) vl = sizeof(verb) - 1;
+            memcpy(verb, line, vl); verb[vl] = '\0'; // the handler may cut the line up
+            UL_TRACE(ipc_start, verb, c->fd);
+            handle_ipc_line(c, line);
+            UL_TRACE(ipc_end, verb, c->fd);
+        }
+    }
+    memmove(c->in, c->in + pos, c->inlen - pos); c->inlen -= pos;
+    if (!c->binary && c->inlen == IPC_BUF) { ipc_reply(c, "ERR too-long\n"); c->inlen = 0; }
+    // group commit: one journal append and one audit fsync for the whole batch, then release the late responses
+    // (text replies are queued too, so they also go out only after the journal write)
+    if (binds_dirty) { binds_dirty = 0; flush_binds(); }
+    if (c->late.n) {
+        audit_sync();
+        if (!outq_splice(&c->out, &c->late)) c->dead = 1;
+    }
+    ipc_flush(c);
+}
+
+// Owner of a local display ":N" is the owner of its X11 socket; other names default to the agent user
+// Only used for --multi / --display: a server started by a display manager (or setuid startx) is owned by root,
+// and such a display cannot be mapped to its session user
+static uid_t display_owner(const char *name) {
+    struct stat st; char path[512];
+    if (name && name[0] == ':') { snprintf(path, sizeof(path), "%s/X%d", X11_SOCKET_DIR, atoi(name + 1)); if (stat(path, &st) == 0) return st.st_uid; }
+    return getuid();
+}
+
+static int find_display(const char *name) {
+    for (int i=0;i<MAX_DISPLAYS;i++) if (displays[i] && strcmp(displays[i]->name, name) == 0) return i;
+    return -1;
+}
+
+// Xlib exits the process on I/O errors by default; unwind to the event loop and drop only the broken display
+static int x_io_error(Display *dpy) { (void)dpy; longjmp(x_io_jmp, 1); return 0; }
+
+static int x_error(Display *dpy, XErrorEvent *e) {
+    char msg[128]; XGetErrorText(dpy, e->error_code, msg, sizeof(msg));
+    fprintf(stderr, "[X] %s: %s\n", DisplayString(dpy), msg);
+    return 0;
+}
+
+static int attach_display(const char *name, int discovered) {
+    int slot = -1; for (int i=0;i<MAX_DISPLAYS;i++) if (!displays[i]) { slot = i; break; }
+    if (slot < 0) return -1;
+    long rss0 = rss_kb();
+    Display *dpy = XOpenDisplay(name);
+    if (!dpy) return -1;
+    struct xdisplay *d = calloc(1, sizeof(*d));
+    if (!d) { XCloseDisplay(dpy); return -1; }
+    snprintf(d->name, sizeof(d->name), "%s", name ? name : DisplayString(dpy));
+    // the default single display belongs to the user running the agent, whoever owns the X server socket
+    d->uid = name ? display_owner(d->name) : getuid(); d->discovered = discovered; d->dpy = dpy;
+    displays[slot] = d; x_cur = slot;
+    // create a simple window to receive SelectionNotify/Request events
+    d->win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0,0,1,1,0,0,0);
+    XMapWindow(dpy, d->win);
+    d->clip = XInternAtom(dpy, "CLIPBOARD", False);
+    d->utf8 = XInternAtom(dpy, "UTF8_STRING", False);
+    d->prop = XInternAtom(dpy, "ULTRALOCK_PROP", False);
+    d->store = XInternAtom(dpy, "ULTRALOCK_CLIP", False);
+    d->text = XInternAtom(dpy, "TEXT", False);
+    XFlush(dpy);
+    x_cur = -1;
+    d->mem_kb = rss_kb() - rss0 + (long)(sizeof(*d) / 1024);
+    printf("[DPY] attached %s (uid %u)\n", d->name, (unsigned)d->uid);
+    if (name && d->uid == 0 && getuid() != 0) fprintf(stderr, "[DPY] %s: X server runs as root, enforcing with root's binds\n", d->name);
+    append_audit("display-attach", d->name);
+    return slot;
+}
+
+// dead: the connection hit an I/O error, so Xlib state is unusable; close the fd and leave the Display struct behind
+static void drop_display(int i, int dead) {
+    struct xdisplay *d = displays[i]; if (!d) return;
+    if (!d->dropping) { d->dropping = 1; printf("[DPY] dropped %s\n", d->name); append_audit("display-drop", d->name); }
+    // XCloseDisplay can hit an I/O error itself; with x_cur set the longjmp handler finishes this drop (dead) instead of another display
+    if (dead) close(ConnectionNumber(d->dpy)); else { int prev = x_cur; x_cur = i; XCloseDisplay(d->dpy); x_cur = prev; }
+    free(d); displays[i] = NULL;
+}
+
+// Attach explicitly requested displays and any local X sessions found under X11_SOCKET_DIR; drop sessions that went away
+static void rescan_displays(void) {
+    for (int w=0; w<n_wanted; w++) if (find_display(wanted_displays[w]) < 0) attach_display(wanted_displays[w], 0);
+    if (!discover_displays) return;
+    char present[MAX_DISPLAYS] = {0};
+    DIR *dir = opendir(X11_SOCKET_DIR);
+    if (dir) {
+        struct dirent *de;
+        while ((de = readdir(dir))) {
+            if (de->d_name[0] != 'X' || !de->d_name[1]) continue;
+            char name[64]; snprintf(name, sizeof(name), ":%s", de->d_name + 1);
+            int i = find_display(name);
+            if (i < 0) i = attach_display(name, 1);
+            if (i >= 0) present[i] = 1;
+        }
+        closedir(dir);
+    }
+    for (int i=0;i<MAX_DISPLAYS;i++) if (displays[i] && displays[i]->discovered && !present[i]) drop_display(i, 0);
+}
+
+// Request UTF8_STRING conversion of CLIPBOARD to our window property; the answer arrives as SelectionNotify
+static void poll_display(struct xdisplay *d, long long now_ms) {
+    XConvertSelection(d->dpy, d->clip, d->utf8, d->prop, d->win, CurrentTime);
+    XFlush(d->dpy);
+    d->polls++; d->poll_sent_us = now_us(); d->next_poll_ms = now_ms + POLL_MS;
+}
+
+static void process_display(struct xdisplay *d) {
+    Display *dpy = d->dpy;
+    while (XPending(dpy)) {
+        XEvent ev; XNextEvent(dpy, &ev);
+        if (ev.type == SelectionNotify) {
+            XSelectionEvent *sev = (XSelectionEvent*)&ev;
+            if (sev->property == None) continue; // conversion failed
+            Atom actual_type; int actual_format; unsigned long nitems, bytes_after; unsigned char *prop = NULL;
+            int rc = XGetWindowProperty(dpy, d->win, sev->property, 0, MAX_CLIP/4, False, AnyPropertyType,
+                                        &actual_type, &actual_format, &nitems, &bytes_after, &prop);
+            if (rc != Success || !prop) continue;
+            char buf[MAX_CLIP]; memset(buf,0,sizeof(buf));
+            int len = (int) (nitems * (actual_format/8));
+            if (len >= MAX_CLIP) len = MAX_CLIP-1;
+            memcpy(buf, prop, len);
+            XFree(prop);
+            // every poll answers; tracer only, so idle polls do not flood the flight recorder
+            UL_PROBE(poll_reply, d->name, len);
+            if (strlen(buf) == 0) continue;
+            // Ignore if same as last
+            if (strcmp(buf, d->last_text) == 0) continue;
+            UL_TRACE(selection_change, d->name, len);
+            strncpy(d->last_text, buf, MAX_CLIP);
+            d->changes++;
+            char canonical[MAX_CLIP]; strncpy(canonical, buf, MAX_CLIP); canonicalize(canonical);
+            char reason[256] = {0};
+            if (check_clipboard_text(buf, reason, sizeof(reason), d->uid)) {
+                if (strstr(canonical, "bc1") || strstr(canonical, "0x") || strstr(canonical, "lnbc"))
+                    printf("[INFO] %s: Clipboard contains bound address; allowing paste. Canonical: %s\n", d->name, canonical);
+                else printf("%s: Clipboard changed: %s\n", d->name, canonical);
+            } else {
+                // Replace clipboard by owning selection and serving the alert text (fail-closed)
+                XSetSelectionOwner(dpy, d->clip, d->win, CurrentTime);
+                XChangeProperty(dpy, d->win, d->store, d->utf8, 8, PropModeReplace, (unsigned char*)reason, strlen(reason));
+                XFlush(dpy);
+                // our own alert text comes back on the next poll; remember it so it is not re-evaluated
+                strncpy(d->last_text, reason, MAX_CLIP);
+                d->blocked++;
+                UL_TRACE(clipboard_replaced, d->name, d->blocked);
+                printf("[ALERT] %s: Replaced clipboard content due to unbound protected address. Canonical: %s\n", d->name, canonical);
+            }
+            // enforcement latency: poll request -> decision applied on the server
+            long long lat = now_us() - d->poll_sent_us;
+            d->lat_sum_us += lat; if (lat > d->lat_max_us) d->lat_max_us = lat;
+        } else if (ev.type == SelectionRequest) {
+            // Another application wants our selection (we may be the owner)
+            XSelectionRequestEvent *req = (XSelectionRequestEvent*)&ev;
+            XEvent resp;
+            memset(&resp, 0, sizeof(resp));
+            resp.xselection.type = SelectionNotify;
+            resp.xselection.display = req->display;
+            resp.xselection.requestor = req->requestor;
+            resp.xselection.selection = req->selection;
+            resp.xselection.time = req->time;
+            resp.xselection.target = req->target;
+            resp.xselection.property = None;
+
+            // Provide UTF8_STRING or STRING
+            Atom actual_type; int actual_format; unsigned long nitems, bytes_after; unsigned char *prop = NULL;
+            int rc = XGetWindowProperty(dpy, d->win, d->store, 0, MAX_CLIP/4, False, AnyPropertyType,
+                                        &actual_type, &actual_format, &nitems, &bytes_after, &prop);
+            if (rc == Success && prop) {
+                if (req->target == d->utf8 || req->target == XA_STRING || req->target == d->text) {
+                    // set property on requestor
+                    XChangeProperty(dpy, req->requestor, req->property, req->target, 8, PropModeReplace, prop, (int)nitems);
+                    resp.xselection.property = req->property;
+                }
+                XFree(prop);
+            }
+            XSendEvent(dpy, req->requestor, False, 0, &resp);
+            XFlush(dpy);
+        }
+    }
+}
+
+// Live upgrade: on SIGHUP or UPGRADE the agent execs its own (possibly replaced) binary and hands the listening
+// socket, the client sockets and a state snapshot to it over a socketpair (SCM_RIGHTS). The old process leaves
+// the sockets untouched until the new one reports READY, so new connections wait in the listen backlog meanwhile.
+// The snapshot is a memfd of native-endian u64 fields and length-prefixed byte strings (same host, any version).
+static void snap_u64(FILE *f, uint64_t v) { fwrite(&v, sizeof(v), 1, f); }
+static void snap_bytes(FILE *f, const void *p, size_t n) { snap_u64(f, n); fwrite(p, 1, n, f); }
+static int snap_get_u64(FILE *f, uint64_t *v) { return fread(v, sizeof(*v), 1, f) == 1; }
+// NUL-terminated copy of a byte string of at most max bytes; NULL on a short or oversized field
+static char *snap_get_bytes(FILE *f, size_t *n, size_t max) {
+    uint64_t len; if (!snap_get_u64(f, &len) || len > max) return NULL;
+    char *b = malloc(len + 1); if (!b) return NULL;
+    if (fread(b, 1, len, f) != len) { free(b); return NULL; }
+    b[len] = '\0'; if (n) *n = len;
+    return b;
+}
+
+// Snapshot of everything a fresh start would lose: salts, audit chain tail, binds and per-client buffers
+static int snapshot_write(int nclients, struct ipc_client **cl) {
+    int mfd = memfd_create("ultralock-state", MFD_CLOEXEC); if (mfd < 0) return -1;
+    int wfd = dup(mfd); FILE *f = wfd >= 0 ? fdopen(wfd, "w") : NULL;
+    if (!f) { if (wfd >= 0) close(wfd); close(mfd); return -1; }
+    fwrite(SNAP_MAGIC, 1, strlen(SNAP_MAGIC), f);
+    snap_bytes(f, device_salt, strlen(device_salt)); snap_bytes(f, session_nonce, strlen(session_nonce)); snap_bytes(f, prev_hash, strlen(prev_hash));
+    snap_u64(f, ns_count);
+    for (size_t h=0;h<NS_BUCKETS;h++) for (struct bind_ns *ns = ns_table[h]; ns; ns = ns->next) {
+        snap_u64(f, ns->uid); snap_bytes(f, ns->origin, strlen(ns->origin));
+        snap_u64(f, ns->limit); snap_u64(f, ns->lookups); snap_u64(f, ns->hits); snap_u64(f, ns->count);
+        for (size_t i=0;i<ns->cap;i++) if (ns->slots[i].used) { fwrite(ns->slots[i].fp, 1, 32, f); snap_u64(f, (uint64_t)ns->slots[i].ts); }
+    }
+    snap_u64(f, nclients);
+    for (int i=0;i<nclients;i++) {
+        struct ipc_client *c = cl[i]; size_t olen = 0;
+        for (int k=0;k<c->out.n;k++) olen += c->out.v[k].iov_len;
+        snap_u64(f, c->uid); snap_u64(f, c->binary); snap_bytes(f, c->in, c->inlen);
+        snap_u64(f, olen); for (int k=0;k<c->out.n;k++) fwrite(c->out.v[k].iov_base, 1, c->out.v[k].iov_len, f);
+    }
+    int bad = fflush(f) != 0 || ferror(f); fclose(f);
+    if (bad) { close(mfd); return -1; }
+    return mfd;
+}
+
+// Restore a snapshot; client fds arrive in the same order as the snapshot lists the clients
+static int snapshot_read(int mfd, int nfds, const int *fds) {
+    FILE *f = fdopen(mfd, "r"); if (!f) return 0;
+    rewind(f); // the writer's offset travels with the descriptor
+    char magic[sizeof(SNAP_MAGIC)] = {0}; char *s; uint64_t n, v[6]; int ok = 0;
+    if (fread(magic, 1, strlen(SNAP_MAGIC), f) != strlen(SNAP_MAGIC) || strcmp(magic, SNAP_MAGIC) != 0) goto out;
+    if (!(s = snap_get_bytes(f, NULL, 64))) goto out;
+    free(device_salt); device_salt = s;
+    if (!(s = snap_get_bytes(f, NULL, 32))) goto out;
+    strcpy(session_nonce, s); free(s);
+    if (!(s = snap_get_bytes(f, NULL, 64))) goto out;
+    strcpy(prev_hash, s); free(s);
+    if (!snap_get_u64(f, &n)) goto out;
+    for (uint64_t k=0;k<n;k++) {
+        char *origin;
+        if (!snap_get_u64(f, &v[0]) || !(origin = snap_get_bytes(f, NULL, MAX_ORIGIN - 1))) goto out;
+        struct bind_ns *ns = find_ns((uid_t)v[0], origin, 1); free(origin);
+        if (!ns || !snap_get_u64(f, &v[1]) || !snap_get_u64(f, &v[2]) || !snap_get_u64(f, &v[3]) || !snap_get_u64(f, &v[4])) goto out;
+        ns->limit = v[1];
+        for (uint64_t i=0;i<v[4];i++) {
+            unsigned char fp[32]; uint64_t ts;
+            if (fread(fp, 1, 32, f) != 32 || !snap_get_u64(f, &ts)) goto out;
+            struct bind_entry *e = insert_bind(ns, fp, 0); if (e) e->ts = (long)ts;
+        }
+        ns->lookups = v[2]; ns->hits = v[3]; // after insert_bind, which counts its own lookups
+    }
+    if (!snap_get_u64(f, &n) || n != (uint64_t)nfds) goto out;
+    for (int i=0;i<nfds;i++) {
+        size_t inlen, olen; char *in, *outb;
+        if (!snap_get_u64(f, &v[0]) || !snap_get_u64(f, &v[1]) || !(in = snap_get_bytes(f, &inlen, IPC_BUF))) goto out;
+        if (!(outb = snap_get_bytes(f, &olen, (size_t)OUT_CHUNK * OUT_MAX_CHUNKS))) { free(in); goto out; }
+        struct ipc_client *c = ipc_slot();
+        if (!c || !(c->in = malloc(IPC_BUF))) { close(fds[i]); free(in); free(outb); continue; }
+        c->fd = fds[i]; c->uid = (uid_t)v[0]; c->binary = (int)v[1]; c->dead = 0; c->last_ms = now_us() / 1000;
+        memcpy(c->in, in, inlen); c->inlen = inlen;
+        if (olen && !outq_put(&c->out, outb, olen)) c->dead = 1;
+        free(in); free(outb);
+    }
+    ok = 1;
+out:
+    fclose(f);
+    return ok;
+}
+
+// Tell systemd (NotifyAccess=all) that this process is the service's main process now
+static void notify_mainpid(void) {
+    const char *ns = getenv("NOTIFY_SOCKET"); if (!ns || (ns[0] != '/' && ns[0] != '@')) return;
+    struct sockaddr_un a; memset(&a, 0, sizeof(a)); a.sun_family = AF_UNIX; strncpy(a.sun_path, ns, sizeof(a.sun_path)-1);
+    if (a.sun_path[0] == '@') a.sun_path[0] = '\0'; // abstract namespace
+    int s = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0); if (s < 0) return;
+    char msg[64]; int n = snprintf(msg, sizeof(msg), "MAINPID=%d\n", (int)getpid());
+    sendto(s, msg, n, MSG_NOSIGNAL, (struct sockaddr*)&a, offsetof(struct sockaddr_un, sun_path) + strlen(ns));
+    close(s);
+}
+
+// New process side of the handoff: receive the fds and the snapshot from the old process
+static int takeover_receive(int sp) {
+    char buf[64] = {0}; int fds[HANDOFF_MAX_FDS], nfds = 0;
+    union { char b[CMSG_SPACE(sizeof(fds))]; struct cmsghdr align; } cm;
+    struct iovec iov = { buf, sizeof(buf) - 1 };
+    struct msghdr m; memset(&m, 0, sizeof(m)); m.msg_iov = &iov; m.msg_iovlen = 1; m.msg_control = cm.b; m.msg_controllen = sizeof(cm.b);
+    if (recvmsg(sp, &m, MSG_CMSG_CLOEXEC) <= 0) return 0;
+    for (struct cmsghdr *h = CMSG_FIRSTHDR(&m); h; h = CMSG_NXTHDR(&m, h))
+        if (h->cmsg_level == SOL_SOCKET && h->cmsg_type == SCM_RIGHTS) { nfds = (h->cmsg_len - CMSG_LEN(0)) / sizeof(int); memcpy(fds, CMSG_DATA(h), nfds * sizeof(int)); }
+    if (strncmp(buf, "HANDOFF ", 8) != 0 || nfds < 2 || (m.msg_flags & MSG_CTRUNC)) return 0;
+    srv_fd = fds[0];
+    return snapshot_read(fds[1], nfds - 2, fds + 2);
+}
+
+// Command line of the new process: the original arguments, with the handoff socket replacing any earlier one
+static char **upgrade_argv(int sp) {
+    static char spbuf[16]; snprintf(spbuf, sizeof(spbuf), "%d", sp);
+    int n = 0; while (self_argv[n]) n++;
+    char **av = calloc(n + 3, sizeof(char*)); if (!av) return NULL;
+    int k = 0; av[k++] = self_exe;
+    for (int i=1;i<n;i++) { if (strcmp(self_argv[i], "--takeover-fd") == 0) { i++; continue; } av[k++] = self_argv[i]; }
+    av[k++] = "--takeover-fd"; av[k++] = spbuf; av[k] = NULL;
+    return av;
+}
+
+// Old process side: returns only if the upgrade failed, in which case this process simply keeps serving
+static void live_upgrade(void) {
+    upgrade_requested = 0;
+    long long t0 = now_us(); const char *why = "fork";
+    binds_dirty = 0; flush_binds(); // includes unaudited BINDs still buffered
+    // send what the sockets take right now; anything left travels in the snapshot
+    struct ipc_client *cl[MAX_CLIENTS]; int nc = 0;
+    for (int i=0;i<n_clients;i++) if (clients[i].fd >= 0) {
+        struct ipc_client *c = &clients[i];
+        if (outq_flush(c->fd, &c->out) < 0 || (c->dead && !c->out.n)) { ipc_close(c); continue; }
+        cl[nc++] = c;
+    }
+    // a shutdown signal during the handoff would audit on a chain tail the new process may already have moved on from:
+    // hold SIGTERM/SIGINT until the handoff is decided, then forward them to the new process or take them here
+    sigset_t stop, oldmask; sigemptyset(&stop); sigaddset(&stop, SIGTERM); sigaddset(&stop, SIGINT);
+    sigprocmask(SIG_BLOCK, &stop, &oldmask);
+    append_audit("upgrade", "handoff-start");
+    UL_TRACE(upgrade_start, "handoff", nc);
+    int sp[2]; if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sp) < 0) { append_audit("upgrade-failed", "socketpair"); sigprocmask(SIG_SETMASK, &oldmask, NULL); return; }
+    int mfd = snapshot_write(nc, cl); char **av = upgrade_argv(sp[1]);
+    if (mfd < 0 || !av) { close(sp[0]); close(sp[1]); if (mfd >= 0) close(mfd); free(av); append_audit("upgrade-failed", "snapshot"); sigprocmask(SIG_SETMASK, &oldmask, NULL); return; }
+    long maxfd = sysconf(_SC_OPEN_MAX); if (maxfd < 0 || maxfd > 65536) maxfd = 65536;
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // only async-signal-safe calls until exec: just the handoff socket survives into the new image
+        for (int fd = 3; fd < maxfd; fd++) if (fd != sp[1]) close(fd);
+        fcntl(sp[1], F_SETFD, 0);
+        sigprocmask(SIG_SETMASK, &oldmask, NULL); // the mask survives exec
+        execv(self_exe, av);
+        _exit(127);
+    }
+    close(sp[1]); free(av);
+    if (pid > 0) {
+        int fds[HANDOFF_MAX_FDS]; int nfds = 0; fds[nfds++] = srv_fd; fds[nfds++] = mfd;
+        for (int i=0;i<nc;i++) fds[nfds++] = cl[i]->fd;
+        union { char b[CMSG_SPACE(sizeof(fds))]; struct cmsghdr align; } cm; memset(&cm, 0, sizeof(cm));
+        char hdr[32]; int hl = snprintf(hdr, sizeof(hdr), "HANDOFF %d\n", nc);
+        struct iovec iov = { hdr, hl };
+        struct msghdr m; memset(&m, 0, sizeof(m)); m.msg_iov = &iov; m.msg_iovlen = 1; m.msg_control = cm.b; m.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *h = CMSG_FIRSTHDR(&m); h->cmsg_level = SOL_SOCKET; h->cmsg_type = SCM_RIGHTS; h->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(h), fds, nfds * sizeof(int));
+        why = "send";
+        if (sendmsg(sp[0], &m, MSG_NOSIGNAL) == hl) {
+            // wait for READY, keeping the watchdog fed; EOF means the new binary failed to start
+            char r[16] = {0}; size_t got = 0; why = "timeout";
+            while (now_us() - t0 < HANDOFF_TIMEOUT_MS * 1000LL) {
+                atomic_store(&loop_heartbeat_ms, now_us() / 1000);
+                fd_set rf; FD_ZERO(&rf); FD_SET(sp[0], &rf); struct timeval tv = { 0, 250000 };
+                if (select(sp[0] + 1, &rf, NULL, NULL, &tv) <= 0) continue;
+                ssize_t n = read(sp[0], r + got, sizeof(r) - 1 - got);
+                if (n <= 0) { why = "child-exited"; break; }
+                got += n;
+                if (strncmp(r, "READY\n", got < 6 ? got : 6) != 0) { why = "bad-reply"; break; }
+                if (got >= 6) {
+                    printf("[UPGRADE] handed over to pid %d after %lld us\n", (int)pid, now_us() - t0); fflush(stdout);
+                    UL_TRACE(upgrade_done, "handoff", now_us() - t0);
+                    sigset_t pend; sigpending(&pend);
+                    if (sigismember(&pend, SIGTERM)) kill(pid, SIGTERM); else if (sigismember(&pend, SIGINT)) kill(pid, SIGINT);
+                    _exit(0); // the sockets live on in the new process; the audit chain belongs to it now
+                }
+            }
+        }
+        kill(pid, SIGKILL); waitpid(pid, NULL, 0);
+    }
+    close(sp[0]); close(mfd);
+    // the new process may have appended before failing, so pick the chain up from the log again
+    audit_recover_tail();
+    append_audit("upgrade-failed", why);
+    fprintf(stderr, "[UPGRADE] failed (%s), still serving\n", why);
+    sigprocmask(SIG_SETMASK, &oldmask, NULL); // a held shutdown signal is delivered now, after upgrade-failed
+}
+
+// Bulk scan (--scan <file|->): find candidate addresses in a large export and report the ones that are not bound.
+// The running agent hands out its salts and the caller's bind namespace (SCANSET); a pool of workers then
+// canonicalizes and fingerprints candidates in parallel against a local copy of that namespace. Files are mmapped
+// and split into chunks; streams are read in double-buffered blocks, so reading overlaps with scanning.
+// Reports go to stdout in input order; the agent records one summarizing audit entry (SCANDONE).
+struct scan_out { char *buf; size_t len, cap; int ready; };
+struct scan_job { const unsigned char *base; size_t len; uint64_t off; int lead_tok; size_t nchunks; _Atomic size_t next; struct scan_out *out; };
+static struct {
+    pthread_mutex_t mu, emit_mu; pthread_cond_t cv, done_cv;
+    struct scan_job *job; unsigned gen; int busy, quit;
+    size_t emitted; // chunks of the current job already written, in order
+    SHA256_CTX report_sha;
+    _Atomic unsigned long long candidates, unbound;
+    _Atomic int out_failed; // report lines lost (out of memory) or not written (stdout error): the report is incomplete
+    const struct bind_ns *set; const char *origin;
+} scan = { .mu = PTHREAD_MUTEX_INITIALIZER, .emit_mu = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER, .done_cv = PTHREAD_COND_INITIALIZER };
+
+// Exports repeat payees a lot: a small per-worker memo of recent candidates skips fingerprinting them again
+struct scan_memo { unsigned char len, bound; char tok[SCAN_MEMO_TOK]; };
+static _Thread_local struct scan_memo *scan_memo;
+
+static int scan_tokch(unsigned char ch) { return (ch >= '0' && ch <= '9') || ((ch | 32) >= 'a' && (ch | 32) <= 'z'); }
+static int scan_prefix(const unsigned char *p, const char *pre) { for (; *pre; p++, pre++) if ((*p | 32) != *pre) return 0; return 1; }
+
+// Candidate tokens, same families as the clipboard check: bech32 bc1..., 0x + 40 hex digits, lnbc invoices
+static int scan_candidate(const unsigned char *p, size_t n) {
+    if (n >= 14 && n <= 90 && scan_prefix(p, "bc1")) return 1;
+    if (n == 42 && scan_prefix(p, "0x")) {
+        for (size_t i=2;i<n;i++) if (!((p[i] >= '0' && p[i] <= '9') || ((p[i] | 32) >= 'a' && (p[i] | 32) <= 'f'))) return 0;
+        return 1;
+    }
+    return n >= 20 && n < MAX_CLIP && scan_prefix(p, "lnbc");
+}
+
+static void scan_put(struct scan_out *o, const char *s, size_t n) {
+    if (o->len + n > o->cap) { size_t nc = o->cap ? o->cap * 2 : 65536; while (nc < o->len + n) nc *= 2; char *b = realloc(o->buf, nc); if (!b) { atomic_store(&scan.out_failed, 1); return; } o->buf = b; o->cap = nc; }
+    memcpy(o->buf + o->len, s, n); o->len += n;
+}
+
+// A chunk owns the tokens starting inside it; a token running past the end is finished here, not by the next chunk
+static void scan_chunk(struct scan_job *j, size_t k) {
+    const unsigned char *b = j->base; size_t s = k * SCAN_CHUNK, e = s + SCAN_CHUNK < j->len ? s + SCAN_CHUNK : j->len, i = s;
+    struct scan_out *o = &j->out[k]; unsigned long long cand = 0, unb = 0;
+    if (s > 0 ? scan_tokch(b[s-1]) : j->lead_tok) while (i < j->len && scan_tokch(b[i])) i++;
+    while (i < e) {
+        if (!scan_tokch(b[i])) { i++; continue; }
+        size_t t = i; while (i < j->len && scan_tokch(b[i])) i++;
+        if (!scan_candidate(b + t, i - t)) continue;
+        char canonical[MAX_CLIP]; memcpy(canonical, b + t, i - t); canonical[i - t] = '\0'; canonicalize_raw(canonical);
+        size_t cl = strlen(canonical); struct scan_memo *m = NULL; int bound; cand++;
+        if (scan_memo && cl < SCAN_MEMO_TOK) {
+            uint32_t h = 2166136261u; for (size_t q=0;q<cl;q++) { h ^= (unsigned char)canonical[q]; h *= 16777619u; }
+            m = &scan_memo[h & (SCAN_MEMO - 1)];
+        }
+        if (m && m->len == cl && memcmp(m->tok, canonical, cl) == 0) bound = m->bound;
+        else {
+            unsigned char fp[32]; fingerprint_raw(canonical, scan.origin, fp); bound = probe_bind(scan.set, fp) != NULL;
+            if (m) { m->len = cl; m->bound = bound; memcpy(m->tok, canonical, cl); }
+        }
+        if (bound) continue;
+        char line[MAX_CLIP + 64]; int n = snprintf(line, sizeof(line), "UNBOUND %llu %s\n", (unsigned long long)(j->off + t), canonical);
+        scan_put(o, line, n); unb++;
+    }
+    atomic_fetch_add(&scan.candidates, cand); atomic_fetch_add(&scan.unbound, unb);
+    // write out every finished chunk that is next in input order
+    pthread_mutex_lock(&scan.emit_mu);
+    o->ready = 1;
+    while (scan.emitted < j->nchunks && j->out[scan.emitted].ready) {
+        struct scan_out *x = &j->out[scan.emitted++];
+        if (x->len) {
+            if (fwrite(x->buf, 1, x->len, stdout) != x->len) atomic_store(&scan.out_failed, 1);
+            sha256_update(&scan.report_sha, (const unsigned char*)x->buf, x->len);
+        }
+        free(x->buf); x->buf = NULL;
+    }
+    pthread_mutex_unlock(&scan.emit_mu);
+}
+
+static void *scan_worker(void *arg) {
+    (void)arg; unsigned seen = 0;
+    scan_memo = calloc(SCAN_MEMO, sizeof(*scan_memo)); // optional: without it every candidate is fingerprinted
+    pthread_mutex_lock(&scan.mu);
+    while (1) {
+        while (scan.gen == seen && !scan.quit) pthread_cond_wait(&scan.cv, &scan.mu);
+        if (scan.quit) break;
+        seen = scan.gen; struct scan_job *j = scan.job;
+        pthread_mutex_unlock(&scan.mu);
+        size_t k; while ((k = atomic_fetch_add(&j->next, 1)) < j->nchunks) scan_chunk(j, k);
+        pthread_mutex_lock(&scan.mu);
+        if (--scan.busy == 0) pthread_cond_signal(&scan.done_cv);
+    }
+    pthread_mutex_unlock(&scan.mu);
+    free(scan_memo); scan_memo = NULL;
+    return NULL;
+}
+
+static int scan_start(struct scan_job *j, const unsigned char *base, size_t len, uint64_t off, int lead_tok, int nthreads) {
+    j->base = base; j->len = len; j->off = off; j->lead_tok = lead_tok; j->nchunks = (len + SCAN_CHUNK - 1) / SCAN_CHUNK;
+    atomic_store(&j->next, 0);
+    if (!(j->out = calloc(j->nchunks ? j->nchunks : 1, sizeof(*j->out)))) return 0;
+    pthread_mutex_lock(&scan.mu);
+    scan.job = j; scan.busy = nthreads; scan.emitted = 0; scan.gen++;
+    pthread_cond_broadcast(&scan.cv);
+    pthread_mutex_unlock(&scan.mu);
+    return 1;
+}
+
+static void scan_wait(struct scan_job *j) {
+    pthread_mutex_lock(&scan.mu);
+    while (scan.busy) pthread_cond_wait(&scan.done_cv, &scan.mu);
+    pthread_mutex_unlock(&scan.mu);
+    free(j->out); j->out = NULL;
+}
+
+// Stream input: the bytes after the last token boundary of a block are carried over to the next one
+static int scan_stream(int fd, int nthreads, uint64_t *total) {
+    unsigned char *buf[2] = { malloc(SCAN_BLOCK + MAX_CLIP), malloc(SCAN_BLOCK + MAX_CLIP) };
+    if (!buf[0] || !buf[1]) { free(buf[0]); free(buf[1]); return 0; }
+    struct scan_job job; int cur = 0, running = 0, lead = 0, eof = 0, ok = 1; size_t have = 0; uint64_t off = 0;
+    while (1) {
+        // fill the current buffer (after any carried bytes) while the workers scan the previous block
+        while (!eof && have < SCAN_BLOCK) {
+            ssize_t n = read(fd, buf[cur] + have, SCAN_BLOCK + MAX_CLIP - have);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) { ok = 0; eof = 1; break; }
+            if (n == 0) eof = 1; else have += n;
+        }
+        if (running) { scan_wait(&job); running = 0; }
+        if (!have) break;
+        size_t cut = have, carry = 0; int next_lead = 0;
+        if (!eof) {
+            while (cut > 0 && scan_tokch(buf[cur][cut-1])) cut--;
+            carry = have - cut;
+            // a token longer than any address is never a candidate; drop it and skip its rest in the next block
+            if (carry >= MAX_CLIP || cut == 0) { cut = have; carry = 0; next_lead = 1; }
+        }
+        if (!scan_start(&job, buf[cur], cut, off, lead, nthreads)) { ok = 0; break; }
+        running = 1;
+        memcpy(buf[1 - cur], buf[cur] + cut, carry);
+        off += cut; *total += cut; lead = next_lead; have = carry; cur = 1 - cur;
+        if (eof && !have) { scan_wait(&job); running = 0; break; }
+    }
+    if (running) scan_wait(&job);
+    free(buf[0]); free(buf[1]);
+    return ok;
+}
+
+// Agent connection for the scanner; the reply side is read line-wise through rf
+static int scan_connect(const char *sockpath, FILE **rf) {
+    int s = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr; memset(&addr, 0, sizeof(addr)); addr.sun_family = AF_UNIX; strncpy(addr.sun_path, sockpath, sizeof(addr.sun_path)-1);
+    if (s < 0 || connect(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) { if (s >= 0) close(s); return -1; }
+    if (!(*rf = fdopen(dup(s), "r"))) { close(s); return -1; }
+    return s;
+}
+
+static int scan_main(const char *path, const char *sockpath, const char *origin, int nthreads) {
+    if (nthreads <= 0) { long n = sysconf(_SC_NPROCESSORS_ONLN); nthreads = n > 0 ? (int)n : 1; }
+    if (nthreads > SCAN_MAX_THREADS) nthreads = SCAN_MAX_THREADS;
+    if (!valid_origin(origin)) { fprintf(stderr, "scan: invalid origin\n"); return 2; }
+    // key and bind set come from the running agent: fingerprints are salted with its session nonce
+    FILE *rf; int s = scan_connect(sockpath, &rf);
+    if (s < 0) { fprintf(stderr, "scan: agent not reachable at %s\n", sockpath); return 2; }
+    char cmd[MAX_ORIGIN + 32]; int cl = strcmp(origin, DEFAULT_ORIGIN) == 0 ? snprintf(cmd, sizeof(cmd), "SCANSET\n") : snprintf(cmd, sizeof(cmd), "SCANSET ORIGIN %s\n", origin);
+    char line[512], salt[129], nonce[65];
+    if (send(s, cmd, cl, MSG_NOSIGNAL) != cl || !fgets(line, sizeof(line), rf) || sscanf(line, "KEY %128s %64s", salt, nonce) != 2) {
+        fprintf(stderr, "scan: agent refused the scan key: %s", line); return 2;
+    }
+    device_salt = strdup(salt); snprintf(session_nonce, sizeof(session_nonce), "%s", nonce);
+    struct bind_ns *set = find_ns(getuid(), origin, 1); if (!set || !device_salt) return 2;
+    while (fgets(line, sizeof(line), rf) && strncmp(line, "END", 3) != 0) {
+        unsigned char fp[32]; line[strcspn(line, "\r\n")] = '\0';
+        if (strncmp(line, "FP ", 3) == 0 && hex_decode(line + 3, fp, 32)) insert_bind(set, fp, 0); // a copy of the agent's set, already within its limits
+    }
+    fclose(rf); close(s); // the agent drops idle clients, so the summary goes over a fresh connection
+    scan.set = set; scan.origin = origin; sha256_init(&scan.report_sha);
+
+    int fd = strcmp(path, "-") == 0 ? 0 : open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { fprintf(stderr, "scan: cannot open %s: %s\n", path, strerror(errno)); return 2; }
+    pthread_t tids[SCAN_MAX_THREADS]; int started = 0;
+    for (; started < nthreads; started++) if (pthread_create(&tids[started], NULL, scan_worker, NULL) != 0) break;
+    if (!started) { fprintf(stderr, "scan: no worker threads\n"); return 2; }
+    long long t0 = now_us(); uint64_t total = 0; int ok = 1;
+    struct stat st;
+    if (fd != 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        // regular file: map it once, workers pull chunks in order so the kernel still sees a mostly sequential read
+        void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) ok = scan_stream(fd, started, &total);
+        else {
+            madvise(m, st.st_size, MADV_SEQUENTIAL);
+            struct scan_job job;
+            if ((ok = scan_start(&job, m, st.st_size, 0, 0, started))) { scan_wait(&job); total = st.st_size; }
+            munmap(m, st.st_size);
+        }
+    } else ok = scan_stream(fd, started, &total);
+    pthread_mutex_lock(&scan.mu); scan.quit = 1; pthread_cond_broadcast(&scan.cv); pthread_mutex_unlock(&scan.mu);
+    for (int i=0;i<started;i++) pthread_join(tids[i], NULL);
+    // a report that did not fully reach stdout must not be audited as complete
+    int out_ok = fflush(stdout) == 0 && !ferror(stdout) && !atomic_load(&scan.out_failed);
+    if (fd != 0) close(fd);
+    long long us = now_us() - t0; if (us <= 0) us = 1;
+
+    // one audit entry for the whole scan, with a digest of the report so it can be checked later
+    unsigned char dig[32]; char dighex[65]; sha256_final(&scan.report_sha, dig); hex_encode(dig, 32, dighex);
+    char name[256]; snprintf(name, sizeof(name), "%s", strcmp(path, "-") == 0 ? "stdin" : path);
+    for (char *q = name; *q; q++) if (*q <= 32 || *q > 126 || *q == '|') *q = '_';
+    unsigned long long cand = atomic_load(&scan.candidates), unb = atomic_load(&scan.unbound);
+    char detail[1024]; snprintf(detail, sizeof(detail), "%s bytes=%llu candidates=%llu unbound=%llu threads=%d ms=%lld origin=%s%s report_sha256=%s",
+        name, (unsigned long long)total, cand, unb, started, us / 1000, origin, ok && out_ok ? "" : " incomplete=1", dighex);
+    char req[1100]; int rl = snprintf(req, sizeof(req), "SCANDONE %s\n", detail);
+    int audited = (s = scan_connect(sockpath, &rf)) >= 0 && send(s, req, rl, MSG_NOSIGNAL) == rl && fgets(line, sizeof(line), rf) && strncmp(line, "OK", 2) == 0;
+    if (s >= 0) { fclose(rf); close(s); }
+    fprintf(stderr, "scan: %llu bytes, %llu candidates, %llu unbound, %d threads, %.1f ms (%.0f MB/s)%s\n",
+        (unsigned long long)total, cand, unb, started, us / 1000.0, total / (double)us, audited ? "" : ", audit entry NOT recorded");
+    if (!ok) { fprintf(stderr, "scan: read error, results incomplete\n"); return 2; }
+    if (!out_ok) { fprintf(stderr, "scan: report not fully written, results incomplete\n"); return 2; }
+    return audited ? (unb ? 1 : 0) : 2;
+}
+
+// signal handling for graceful shutdown
+static void handle_sig(int s) {
+    (void)s;
+    append_audit("shutdown", "signal-received");
+    if (srv_fd >= 0) close(srv_fd);
+    _exit(0);
+}
+
+// SIGHUP: live upgrade, performed from the event loop
+static void handle_hup(int s) { (void)s; upgrade_requested = 1; }
+
 int main(int argc, char **argv) {
-    printf("UltraLock clipwatch prototype starting...\n");
     // allow a headless self-test mode: ./clipwatch --selftest
-    int selftest = 0; int daemon_mode = 0;
+    // multi-display mode: ./clipwatch --multi [--display :N ...] [--socket PATH]
+    // per-namespace bind limit: --ns-limit N (default NS_MAX_BINDS)
+    // --takeover-fd N is passed by a live upgrade (SIGHUP / UPGRADE) to the new process, not meant for manual use
+    // bulk scan against the running agent: ./clipwatch --scan <file|-> [--origin O] [--threads N]
+    int selftest = 0; int daemon_mode = 0; int multi = 0; const char *sock_override = NULL; int takeover_fd = -1;
+    const char *scan_path = NULL, *scan_origin = DEFAULT_ORIGIN; int scan_threads = 0;
     for (int i=1;i<argc;i++) {
         if (strcmp(argv[i], "--selftest") == 0) selftest = 1;
         if (strcmp(argv[i], "--daemon") == 0) daemon_mode = 1;
+        if (strcmp(argv[i], "--multi") == 0) { multi = 1; discover_displays = 1; }
+        if (strcmp(argv[i], "--display") == 0 && i+1 < argc && n_wanted < MAX_DISPLAYS) { multi = 1; wanted_displays[n_wanted++] = argv[++i]; }
+        if (strcmp(argv[i], "--socket") == 0 && i+1 < argc) sock_override = argv[++i];
+        if (strcmp(argv[i], "--ns-limit") == 0 && i+1 < argc) { long v = atol(argv[++i]); if (v > 0) ns_limit = v > MAX_BINDS ? MAX_BINDS : (size_t)v; }
+        if (strcmp(argv[i], "--takeover-fd") == 0 && i+1 < argc) takeover_fd = atoi(argv[++i]);
+        if (strcmp(argv[i], "--scan") == 0 && i+1 < argc) scan_path = argv[++i];
+        if (strcmp(argv[i], "--origin") == 0 && i+1 < argc) scan_origin = argv[++i];
+        if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) scan_threads = atoi(argv[++i]);
     }
+    // the path, not the inode: an upgrade execs whatever binary is installed there by then
+    self_argv = argv;
+    ssize_t xl = readlink("/proc/self/exe", self_exe, sizeof(self_exe) - 1); self_exe[xl > 0 ? xl : 0] = '\0';
+    if (xl > 10 && strcmp(self_exe + xl - 10, " (deleted)") == 0) self_exe[xl - 10] = '\0';
 
-    char *device_salt = read_or_create_device_salt();
+    char sockpath[1024];
+    const char *xdg_runtime = getenv("XDG_RUNTIME_DIR");
+    if (sock_override) snprintf(sockpath, sizeof(sockpath), "%s", sock_override);
+    else if (xdg_runtime && xdg_runtime[0]) snprintf(sockpath, sizeof(sockpath), "%s/ultralock.sock", xdg_runtime);
+    else {
+        const char *home = getenv("HOME");
+        snprintf(sockpath, sizeof(sockpath), "%s/.local/share/ultralock.sock", home);
+    }
+    // scan mode runs no watchdog and records nothing (workers use the untraced variants); a SIGUSR1 aimed at the agent must not kill it
+    if (scan_path) { signal(SIGUSR1, SIG_IGN); return scan_main(scan_path, sockpath, scan_origin, scan_threads); }
+    printf("UltraLock clipwatch prototype starting...\n"); // not in scan mode, where stdout carries the report
+
+    device_salt = read_or_create_device_salt();
     if (!device_salt) { fprintf(stderr, "Failed to get device salt\n"); return 1; }
-    char session_nonce[33];
     unsigned char rn[16]; FILE *ur = fopen("/dev/urandom", "rb"); if (ur) { fread(rn,1,16,ur); fclose(ur); }
     for (int i=0;i<16;i++) sprintf(session_nonce + (i*2), "%02x", rn[i]);
     session_nonce[32] = '\0';
 
-    // Registered fingerprints (simple fixed-size store)
-    struct bind_entry binds[MAX_BINDS]; memset(binds,0,sizeof(binds));
-
     // Bind persistence path (durable binds across restarts)
-    char binds_path[1024]; const char *xdgdata = getenv("XDG_DATA_HOME");
+    const char *xdgdata = getenv("XDG_DATA_HOME");
     if (xdgdata && xdgdata[0]) snprintf(binds_path, sizeof(binds_path), "%s/ultralock_binds.txt", xdgdata);
     else { const char *home = getenv("HOME"); snprintf(binds_path, sizeof(binds_path), "%s/.local/share/ultralock_binds.txt", home); }
+    snprintf(journal_path, sizeof(journal_path), "%s.journal", binds_path);
     char binds_dir[1024]; strncpy(binds_dir, binds_path, sizeof(binds_dir)); char *bdp = strrchr(binds_dir, '/'); if (bdp) *bdp='\0'; mkdir(binds_dir, 0700);
 
     // Audit log setup (append-only)
-    char audit_path[1024]; xdgdata = getenv("XDG_RUNTIME_DIR");
+    xdgdata = getenv("XDG_RUNTIME_DIR");
     if (xdgdata && xdgdata[0]) snprintf(audit_path, sizeof(audit_path), "%s/ultralock_audit.log", xdgdata);
     else { const char *home = getenv("HOME"); snprintf(audit_path, sizeof(audit_path), "%s/.local/share/ultralock_audit.log", home); }
     char audit_dir[1024]; strncpy(audit_dir, audit_path, sizeof(audit_dir)); char *adp = strrchr(audit_dir, '/'); if (adp) *adp='\0'; mkdir(audit_dir, 0700);
-    int audit_fd = open(audit_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
-    char prev_hash[65] = {0};
+    audit_fd = open(audit_path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+    // flight recorder dumps go next to the audit log
+    snprintf(flight_path, sizeof(flight_path), "%s/ultralock_flight.log", audit_dir);
     if (audit_fd < 0) { perror("audit open"); }
-    else {
-        // read last line to recover prev_hash
-        FILE *af = fopen(audit_path, "r"); if (af) {
-            char line[4096]; char lastline[4096] = {0};
-            while (fgets(line, sizeof(line), af)) { strncpy(lastline, line, sizeof(lastline)); }
-            fclose(af);
-            // extract last hash (after last '|')
-            char *p = strrchr(lastline, '|'); if (p) { p++; size_t l = strlen(p); while (l && (p[l-1]=='\n' || p[l-1]=='\r')) { p[--l]='\0'; } strncpy(prev_hash, p, 65); }
-        }
-    }
+    else audit_recover_tail(); // read last line to recover prev_hash
 
-    // helper to append audit entries
-    void append_audit(const char *op, const char *detail) {
-        if (audit_fd < 0) return;
-        char ts[64]; time_t now = time(NULL); snprintf(ts, sizeof(ts), "%ld", now);
-        // compute hash = sha256(prev_hash||ts||op||detail)
-        char payload[4096]; snprintf(payload, sizeof(payload), "%s|%s|%s|%s", prev_hash, ts, op, detail);
-        char newh[65]; sha256_hex(payload, newh);
-        char out[8192]; snprintf(out, sizeof(out), "%s|%s|%s|%s\n", ts, op, detail, newh);
-        write(audit_fd, out, strlen(out)); // ignoring errors
-        strncpy(prev_hash, newh, 65);
-        fsync(audit_fd);
-    }
-
-    // helper to persist binds atomically
-    void save_binds() {
-        char tmp[1024]; snprintf(tmp, sizeof(tmp), "%s.tmp", binds_path);
-        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
-        if (fd < 0) { append_audit("save-binds-fail", "open"); return; }
-        for (int i=0;i<MAX_BINDS;i++) if (binds[i].fp[0]) {
-            char line[128]; int n = snprintf(line, sizeof(line), "%s %ld\n", binds[i].fp, binds[i].ts);
-            write(fd, line, n);
-        }
-        fsync(fd); close(fd);
-        rename(tmp, binds_path);
-        append_audit("save-binds", binds_path);
-    }
-
-    // helper to load binds from persistence
-    void load_binds() {
-        FILE *f = fopen(binds_path, "r"); if (!f) { append_audit("load-binds", "none"); return; }
-        char line[256]; int idx = 0; while (fgets(line, sizeof(line), f)) {
-            char fp[65]; long ts; if (sscanf(line, "%64s %ld", fp, &ts) == 2) {
-                strncpy(binds[idx].fp, fp, 65); binds[idx].ts = ts; idx++; if (idx>=MAX_BINDS) break;
-            }
-        }
-        fclose(f);
-        append_audit("load-binds", binds_path);
-    }
-
-    // load persisted binds at startup
-    load_binds();
-
-    // signal handling for graceful shutdown
-    int running = 1; int srv_fd = 0;
-    void handle_sig(int s) {
-        append_audit("shutdown", "signal-received");
-        running = 0;
-        if (srv_fd) close(srv_fd);
-        _exit(0);
-    }
+    // load persisted binds at startup, or take over state and sockets from the agent being upgraded
+    if (takeover_fd >= 0) {
+        if (!takeover_receive(takeover_fd)) { fprintf(stderr, "takeover: handoff from previous agent failed\n"); return 1; }
+    } else load_binds();
+    open_journal();
 
     // IPC socket setup (prepare path & server regardless of X state for headless tests)
-    char sockpath[1024];
-    const char *xdg_runtime = getenv("XDG_RUNTIME_DIR");
-    if (xdg_runtime && xdg_runtime[0]) snprintf(sockpath, sizeof(sockpath), "%s/ultralock.sock", xdg_runtime);
-    else {
-        const char *home = getenv("HOME");
-        snprintf(sockpath, sizeof(sockpath), "%s/.local/share/ultralock.sock", home);
-    }
     // Ensure parent directory exists and has restricted perms
     char sockdir[1024]; strncpy(sockdir, sockpath, sizeof(sockdir)); char *ps = strrchr(sockdir, '/'); if (ps) *ps='\0'; mkdir(sockdir, 0700);
-    // Remove stale socket
-    unlink(sockpath);
-
-    int srv = socket(AF_UNIX, SOCK_STREAM, 0);
-    srv_fd = srv;
-    if (srv < 0) { perror("socket"); return 1; }
-    struct sockaddr_un addr; memset(&addr,0,sizeof(addr)); addr.sun_family = AF_UNIX; strncpy(addr.sun_path, sockpath, sizeof(addr.sun_path)-1);
-
     // Install signal handlers
     struct sigaction sa; memset(&sa,0,sizeof(sa)); sa.sa_handler = handle_sig; sigaction(SIGTERM, &sa, NULL); sigaction(SIGINT, &sa, NULL);
+    sa.sa_handler = handle_hup; sigaction(SIGHUP, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int srv = srv_fd; // already listening after a takeover
+    if (takeover_fd < 0) {
+        // Remove stale socket
+        unlink(sockpath);
 
-    append_audit("start", "agent-started");
-    if (bind(srv, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); close(srv); return 1; }
-    chmod(sockpath, 0600);
-    if (listen(srv, 5) < 0) { perror("listen"); close(srv); return 1; }
+        srv = socket(AF_UNIX, SOCK_STREAM, 0);
+        srv_fd = srv;
+        if (srv < 0) { perror("socket"); return 1; }
+        struct sockaddr_un addr; memset(&addr,0,sizeof(addr)); addr.sun_family = AF_UNIX; strncpy(addr.sun_path, sockpath, sizeof(addr.sun_path)-1);
+
+        append_audit("start", "agent-started");
+        if (bind(srv, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); close(srv); return 1; }
+        // a shared multi-display socket is reachable by every session user; SO_PEERCRED keeps their binds apart
+        chmod(sockpath, multi ? 0666 : 0600);
+        // deep backlog: connections made while a live upgrade is in flight wait here instead of being refused
+        if (listen(srv, SOMAXCONN) < 0) { perror("listen"); close(srv); return 1; }
+    }
 
     if (selftest) {
         // perform a headless integration test: bind a FP for a test address, then verify check allows it
         const char *test_addr = "bc1qw9cqf600jzcvkd53lpf6j9w93x806z5x5c0t8q";
         char canonical[MAX_CLIP]; strncpy(canonical, test_addr, MAX_CLIP); canonicalize(canonical);
-        char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", canonical, "local-origin", device_salt, session_nonce);
-        char fp[65]; sha256_hex(composite, fp);
+        unsigned char fp[32]; fingerprint(canonical, DEFAULT_ORIGIN, fp);
         // bind it
-        strncpy(binds[0].fp, fp, 65); binds[0].ts = time(NULL);
+        store_bind(find_ns(getuid(), DEFAULT_ORIGIN, 1), fp);
         char reason[256] = {0};
-        int ok = check_clipboard_text(test_addr, reason, sizeof(reason), device_salt, session_nonce, binds);
+        int ok = check_clipboard_text(test_addr, reason, sizeof(reason), getuid());
         if (ok) {
             printf("address is safe and passed\n");
             return 0;
@@ -329,239 +1754,103 @@ int main(int argc, char **argv) {
         }
     }
 
-    // If running in daemon mode, continue with IPC-only loop (no X)
+    // SIGUSR1 is handled by the watchdog thread (sigtimedwait), so keep it blocked here
+    sigset_t usr1; sigemptyset(&usr1); sigaddset(&usr1, SIGUSR1); pthread_sigmask(SIG_BLOCK, &usr1, NULL);
+    atomic_store(&loop_heartbeat_ms, now_us() / 1000);
+    pthread_t wd; if (pthread_create(&wd, NULL, watchdog_main, NULL) == 0) pthread_detach(wd);
+
+    // Daemon mode runs the IPC-only loop (no X); otherwise attach one display, or many in multi-display mode
+    int ino_fd = -1;
     if (daemon_mode) {
         printf("UltraLock running in daemon-only mode (IPC only)\n");
-        int client_fds[8]; for (int i=0;i<8;i++) client_fds[i] = -1;
-        while (1) {
-            fd_set readfds; FD_ZERO(&readfds);
-            FD_SET(srv, &readfds);
-            int maxfd = srv;
-            for (int i=0;i<8;i++) if (client_fds[i] >= 0) { FD_SET(client_fds[i], &readfds); if (client_fds[i] > maxfd) maxfd = client_fds[i]; }
-            struct timeval tv; tv.tv_sec = 1; tv.tv_usec = 0;
-            int sel = select(maxfd + 1, &readfds, NULL, NULL, &tv);
-            if (sel <= 0) continue;
-            if (FD_ISSET(srv, &readfds)) {
-                int c = accept(srv, NULL, NULL);
-                if (c >= 0) {
-                    int placed = 0; for (int i=0;i<8;i++) if (client_fds[i] < 0) { client_fds[i] = c; placed = 1; break; }
-                    if (!placed) { close(c); }
-                    else printf("[IPC] client connected\n");
-                }
-            }
-            for (int i=0;i<8;i++) {
-                int cfd = client_fds[i]; if (cfd < 0) continue; if (!FD_ISSET(cfd, &readfds)) continue;
-                char rbuf[1024]; ssize_t r = recv(cfd, rbuf, sizeof(rbuf)-1, 0);
-                if (r <= 0) { close(cfd); client_fds[i] = -1; continue; }
-                rbuf[r] = '\0'; char *line = strtok(rbuf, "\r\n");
-                while (line) {
-                    if (strncmp(line, "BIND ", 5) == 0) {
-                        char *fp = line + 5; if (strlen(fp) == 64) { int stored = 0; for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0]==0) { strcpy(binds[b].fp, fp); binds[b].ts = time(NULL); stored=1; break; } if (stored) send(cfd, "OK\n", 3, 0); else send(cfd, "ERR full\n", 10, 0); } else send(cfd, "ERR invalid-fp\n", 16, 0);
-                    } else if (strncmp(line, "BINDADDR ", 9) == 0) {
-                        char *addr = line + 9; if (strlen(addr) > 0) {
-                            // strict input validation: sane length and printable, no CR/LF
-                            if (strlen(addr) < 10 || strlen(addr) > 512) { send(cfd, "ERR invalid-addr\n", 17, 0); line = strtok(NULL, "\r\n"); continue; }
-                            int bad = 0; for (int ii=0; addr[ii]; ii++) { unsigned char ch = addr[ii]; if (ch <= 32 || ch == '\r' || ch == '\n') { bad=1; break; } }
-                            if (bad) { send(cfd, "ERR invalid-addr\n", 17, 0); line = strtok(NULL, "\r\n"); continue; }
-                            char canonical[MAX_CLIP]; strncpy(canonical, addr, MAX_CLIP); canonicalize(canonical);
-                            char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", canonical, "local-origin", device_salt, session_nonce);
-                            char fp2[65]; sha256_hex(composite, fp2);
-                            int stored = 0; for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0]==0) { strncpy(binds[b].fp, fp2, 65); binds[b].ts = time(NULL); stored = 1; break; }
-                            if (stored) { send(cfd, "OK\n", 3, 0); append_audit("bindaddr", canonical); save_binds(); } else send(cfd, "ERR full\n", 10, 0);
-                        } else send(cfd, "ERR invalid-addr\n", 17, 0);
-                    } else if (strncmp(line, "UNBIND ", 7) == 0) {
-                        char *fp = line + 7; int found=0; for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0] && strcmp(binds[b].fp, fp)==0) { binds[b].fp[0]=0; binds[b].ts=0; found=1; break; } if (found) { send(cfd, "OK\n", 3, 0); save_binds(); append_audit("unbind", fp); } else send(cfd, "ERR notfound\n", 14, 0);
-                    } else if (strncmp(line, "UNBINDADDR ", 11) == 0) {
-                        char *addr = line + 11; if (strlen(addr)>0) {
-                            char canonical[MAX_CLIP]; strncpy(canonical, addr, MAX_CLIP); canonicalize(canonical);
-                            char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", canonical, "local-origin", device_salt, session_nonce);
-                            char fp3[65]; sha256_hex(composite, fp3);
-                            int found=0; for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0] && strcmp(binds[b].fp, fp3)==0) { binds[b].fp[0]=0; binds[b].ts=0; found=1; break; } if (found) { send(cfd, "OK\n", 3, 0); append_audit("unbindaddr", canonical); save_binds(); } else send(cfd, "ERR notfound\n", 14, 0);
-                        } else send(cfd, "ERR invalid-addr\n", 17, 0);
-                    } else if (strcmp(line, "LIST") == 0) {
-                        append_audit("list", "client-list");
-                        for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0]) { char out[128]; snprintf(out, sizeof(out), "FP %s %ld\n", binds[b].fp, binds[b].ts); send(cfd, out, strlen(out), 0); }
-                        send(cfd, "END\n", 4, 0);
-                    } else if (strncmp(line, "VERIFYADDR ", 11) == 0) {
-                        char *addr = line + 11; char canonical[MAX_CLIP]; strncpy(canonical, addr, MAX_CLIP); canonicalize(canonical);
-                        char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", canonical, "local-origin", device_salt, session_nonce);
-                        char fpv[65]; sha256_hex(composite, fpv);
-                        int ok=0; for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0] && strcmp(binds[b].fp, fpv)==0) { ok=1; break; }
-                        if (ok) { send(cfd, "OK\n", 3, 0); append_audit("verify", canonical); } else { send(cfd, "ERR notbound\n", 14, 0); append_audit("verify-failed", canonical); }
-                    } else {
-                        send(cfd, "ERR unknown\n", 12, 0);
-                    }
-                    line = strtok(NULL, "\r\n");
-                }
-            }
+    } else {
+        XSetErrorHandler(x_error);
+        XSetIOErrorHandler(x_io_error);
+        if (multi) {
+            if (discover_displays) { ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC); if (ino_fd >= 0 && inotify_add_watch(ino_fd, X11_SOCKET_DIR, IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) < 0) { close(ino_fd); ino_fd = -1; } }
+            printf("UltraLock running in multi-display mode\n");
+        } else {
+            // the handler above may already fire while attaching (single and takeover mode), before the loop's setjmp
+            if (setjmp(x_io_jmp)) { fprintf(stderr, "X display connection lost\n"); return 1; }
+            if (attach_display(NULL, 0) < 0) { fprintf(stderr, "Failed to open X display\n"); return 1; }
         }
     }
 
-    // Normal operation: open X display and proceed with event loop
-    Display *dpy = XOpenDisplay(NULL);
-    if (!dpy) { fprintf(stderr, "Failed to open X display\n"); return 1; }
-    Window root = DefaultRootWindow(dpy);
-    // create a simple window to receive SelectionNotify/Request events
-    Window win = XCreateSimpleWindow(dpy, root, 0,0,1,1,0,0,0);
-    XMapWindow(dpy, win);
-    XFlush(dpy);
-
-    Atom clip = XInternAtom(dpy, "CLIPBOARD", False);
-    Atom utf8 = XInternAtom(dpy, "UTF8_STRING", False);
-
-    char last_text[MAX_CLIP] = {0};
-    int client_fds[8]; for (int i=0;i<8;i++) client_fds[i] = -1;
+    if (takeover_fd >= 0) {
+        // serving from here on: tell systemd and the old process, which exits on READY
+        char detail[64]; snprintf(detail, sizeof(detail), "pid=%d", (int)getpid());
+        append_audit("takeover", detail);
+        notify_mainpid();
+        if (write(takeover_fd, "READY\n", 6) != 6) { fprintf(stderr, "takeover: previous agent went away\n"); return 1; }
+        close(takeover_fd);
+        printf("UltraLock took over from the previous agent\n"); fflush(stdout);
+    }
 
+    volatile long long next_rescan_ms = 0; // written between setjmp and a possible longjmp
     while (1) {
-        // Proper SelectionNotify flow: request UTF8_STRING conversion to our window property
-        Atom property = XInternAtom(dpy, "ULTRALOCK_PROP", False);
-        XConvertSelection(dpy, clip, utf8, property, win, CurrentTime);
-        XFlush(dpy);
+        if (setjmp(x_io_jmp)) {
+            // an X server went away underneath us
+            if (x_cur >= 0 && displays[x_cur]) drop_display(x_cur, 1);
+            x_cur = -1;
+            if (!multi) { fprintf(stderr, "X display connection lost\n"); return 1; }
+            continue;
+        }
+        if (upgrade_requested) live_upgrade();
+        long long now_ms = now_us() / 1000;
+        atomic_store(&loop_heartbeat_ms, now_ms);
+        if (multi && now_ms >= next_rescan_ms) { rescan_displays(); next_rescan_ms = now_ms + RESCAN_MS; }
 
-        // Build fd set including X11 connection, server socket, and any client sockets
-        int x11fd = ConnectionNumber(dpy);
+        // Build fd set including every X11 connection, server socket, and any client sockets
         fd_set readfds; FD_ZERO(&readfds);
-        FD_SET(x11fd, &readfds);
+        fd_set writefds; FD_ZERO(&writefds);
         FD_SET(srv, &readfds);
-        int maxfd = x11fd > srv ? x11fd : srv;
-        for (int i=0;i<8;i++) if (client_fds[i] >= 0) { FD_SET(client_fds[i], &readfds); if (client_fds[i] > maxfd) maxfd = client_fds[i]; }
+        int maxfd = srv;
+        // a client with unsent responses is not read from until they drain
+        for (int i=0;i<n_clients;i++) if (clients[i].fd >= 0) { FD_SET(clients[i].fd, clients[i].out.n ? &writefds : &readfds); if (clients[i].fd > maxfd) maxfd = clients[i].fd; }
+        if (ino_fd >= 0) { FD_SET(ino_fd, &readfds); if (ino_fd > maxfd) maxfd = ino_fd; }
+        long long wait_ms = daemon_mode ? 1000 : POLL_MS; int queued = 0;
+        for (int i=0;i<MAX_DISPLAYS;i++) {
+            struct xdisplay *d = displays[i]; if (!d) continue;
+            x_cur = i;
+            if (now_ms >= d->next_poll_ms) poll_display(d, now_ms);
+            if (d->next_poll_ms - now_ms < wait_ms) wait_ms = d->next_poll_ms - now_ms;
+            if (XQLength(d->dpy) > 0) queued = 1;
+            int x11fd = ConnectionNumber(d->dpy);
+            FD_SET(x11fd, &readfds); if (x11fd > maxfd) maxfd = x11fd;
+        }
+        x_cur = -1;
+        if (multi && next_rescan_ms - now_ms < wait_ms) wait_ms = next_rescan_ms - now_ms;
+        if (queued || wait_ms < 0) wait_ms = 0;
 
         // Wait for events with a timeout
-        struct timeval tv; tv.tv_sec = 0; tv.tv_usec = POLL_MS * 1000;
-        int sel = select(maxfd + 1, &readfds, NULL, NULL, &tv);
-        if (sel <= 0) {
-            // no events, but still process any pending X events (non-blocking)
-            while (XPending(dpy)) {
-                XEvent ev; XNextEvent(dpy, &ev);
-                // handle events below (reuse same code path)
-                if (ev.type == SelectionNotify) {
-                    // fall through to current handler by pushing back event (simple approach: handle inline)
-                }
-            }
-            continue;
-        }
+        struct timeval tv; tv.tv_sec = wait_ms / 1000; tv.tv_usec = (wait_ms % 1000) * 1000;
+        int sel = select(maxfd + 1, &readfds, &writefds, NULL, &tv);
+        if (sel < 0) continue;
 
         // Accept new client connections
-        if (FD_ISSET(srv, &readfds)) {
-            int c = accept(srv, NULL, NULL);
-            if (c >= 0) {
-                int placed = 0;
-                for (int i=0;i<8;i++) if (client_fds[i] < 0) { client_fds[i] = c; placed=1; break; }
-                if (!placed) { close(c); }
-                else { printf("[IPC] client connected\n"); }
-            }
-        }
+        if (FD_ISSET(srv, &readfds)) ipc_accept();
 
         // process client data
-        for (int i=0;i<8;i++) {
-            int cfd = client_fds[i];
-            if (cfd < 0) continue;
-            if (!FD_ISSET(cfd, &readfds)) continue;
-            char rbuf[1024]; ssize_t r = recv(cfd, rbuf, sizeof(rbuf)-1, 0);
-            if (r <= 0) { close(cfd); client_fds[i] = -1; continue; }
-            rbuf[r] = '\0';
-            // simple line handling: split on newlines
-            char *line = strtok(rbuf, "\r\n");
-            while (line) {
-                if (strncmp(line, "BIND ", 5) == 0) {
-                    char *fp = line + 5;
-                    if (strlen(fp) == 64) {
-                        // store
-                        int stored = 0;
-                        for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0]==0) { strcpy(binds[b].fp, fp); binds[b].ts = time(NULL); stored=1; break; }
-                        if (stored) send(cfd, "OK\n", 3, 0); else send(cfd, "ERR full\n", 10, 0);
-                    } else send(cfd, "ERR invalid-fp\n", 16, 0);
-                } else if (strncmp(line, "UNBIND ", 7) == 0) {
-                    char *fp = line + 7; int found=0;
-                    for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0] && strcmp(binds[b].fp, fp)==0) { binds[b].fp[0]=0; binds[b].ts=0; found=1; break; }
-                    if (found) send(cfd, "OK\n", 3, 0); else send(cfd, "ERR notfound\n", 14, 0);
-                } else if (strcmp(line, "LIST") == 0) {
-                    for (int b=0;b<MAX_BINDS;b++) if (binds[b].fp[0]) { char out[128]; snprintf(out, sizeof(out), "FP %s %ld\n", binds[b].fp, binds[b].ts); send(cfd, out, strlen(out), 0); }
-                    send(cfd, "END\n", 4, 0);
-                } else {
-                    send(cfd, "ERR unknown\n", 12, 0);
-                }
-                line = strtok(NULL, "\r\n");
-            }
+        for (int i=0;i<n_clients;i++) {
+            struct ipc_client *c = &clients[i]; if (c->fd < 0) continue;
+            if (FD_ISSET(c->fd, &writefds)) ipc_flush(c);
+            else if (FD_ISSET(c->fd, &readfds)) ipc_service(c);
+            else if (now_ms - c->last_ms > IPC_IDLE_MS) { printf("[IPC] idle client dropped\n"); ipc_close(c); }
+        }
+
+        // X11 sockets appeared or vanished: rescan right away instead of waiting for the periodic rescan
+        if (ino_fd >= 0 && FD_ISSET(ino_fd, &readfds)) {
+            char ibuf[4096]; while (read(ino_fd, ibuf, sizeof(ibuf)) > 0) {}
+            next_rescan_ms = 0;
         }
 
         // Handle any pending X events
-        while (XPending(dpy)) {
-            XEvent ev; XNextEvent(dpy, &ev);
-            if (ev.type == SelectionNotify) {
-                XSelectionEvent *sev = (XSelectionEvent*)&ev;
-                if (sev->property == None) continue; // conversion failed
-                Atom actual_type; int actual_format; unsigned long nitems, bytes_after; unsigned char *prop = NULL;
-                int rc = XGetWindowProperty(dpy, win, sev->property, 0, MAX_CLIP/4, False, AnyPropertyType,
-                                            &actual_type, &actual_format, &nitems, &bytes_after, &prop);
-                if (rc == Success && prop) {
-                    char buf[MAX_CLIP]; memset(buf,0,sizeof(buf));
-                    int len = (int) (nitems * (actual_format/8));
-                    if (len >= MAX_CLIP) len = MAX_CLIP-1;
-                    memcpy(buf, prop, len);
-                    if (prop) XFree(prop);
-                    if (strlen(buf) == 0) continue;
-                    // Ignore if same as last
-                    if (strcmp(buf, last_text) == 0) continue;
-                    strncpy(last_text, buf, MAX_CLIP);
-                    char canonical[MAX_CLIP]; strncpy(canonical, buf, MAX_CLIP); canonicalize(canonical);
-                    char composite[4096]; snprintf(composite, sizeof(composite), "%s||%s||%s||%s", canonical, "local-origin", device_salt, session_nonce);
-                    char fp[65]; sha256_hex(composite, fp);
-                    int is_addr = 0; if (strstr(canonical, "bc1") || strstr(canonical, "0x") || strstr(canonical, "lnbc")) is_addr = 1;
-                    if (is_addr) {
-                        // Compute fingerprint and check registered binds
-                        char fp[65]; sha256_hex(composite, fp);
-                        int allowed = 0;
-                        for (int b=0;b<MAX_BINDS;b++) { if (binds[b].fp[0] && strcmp(binds[b].fp, fp)==0) { allowed=1; break; } }
-                        if (allowed) {
-                            printf("[INFO] Clipboard contains bound address; allowing paste. Canonical: %s\n", canonical);
-                        } else {
-                            // Replace clipboard by owning selection and serving the alert text (fail-closed)
-                            char *msg = "[UltraLock ALERT] Clipboard content appears to be a protected address; paste blocked by UltraLock.";
-                            // become selection owner and store message
-                            XSetSelectionOwner(dpy, clip, win, CurrentTime);
-                            // store message in atom 'ULTRALOCK_CLIP'
-                            Atom clip_atom = XInternAtom(dpy, "ULTRALOCK_CLIP", False);
-                            XChangeProperty(dpy, win, clip_atom, utf8, 8, PropModeReplace, (unsigned char*)msg, strlen(msg));
-                            printf("[ALERT] Replaced clipboard content due to unbound protected address. Canonical: %s\n", canonical);
-                        }
-                    } else {
-                        printf("Clipboard changed: %s\n", canonical);
-                    }
-                }
-            } else if (ev.type == SelectionRequest) {
-                // Another application wants our selection (we may be the owner)
-                XSelectionRequestEvent *req = (XSelectionRequestEvent*)&ev;
-                XEvent resp;
-                memset(&resp, 0, sizeof(resp));
-                resp.xselection.type = SelectionNotify;
-                resp.xselection.display = req->display;
-                resp.xselection.requestor = req->requestor;
-                resp.xselection.selection = req->selection;
-                resp.xselection.time = req->time;
-                resp.xselection.target = req->target;
-                resp.xselection.property = None;
-
-                // Provide UTF8_STRING or STRING
-                Atom clip_atom = XInternAtom(dpy, "ULTRALOCK_CLIP", False);
-                Atom actual_type; int actual_format; unsigned long nitems, bytes_after; unsigned char *prop = NULL;
-                int rc = XGetWindowProperty(dpy, win, clip_atom, 0, MAX_CLIP/4, False, AnyPropertyType,
-                                            &actual_type, &actual_format, &nitems, &bytes_after, &prop);
-                if (rc == Success && prop) {
-                    Atom textAtom = XInternAtom(dpy, "TEXT", False);
-                    if (req->target == utf8 || req->target == XA_STRING || req->target == textAtom) {
-                        // set property on requestor
-                        XChangeProperty(dpy, req->requestor, req->property, req->target, 8, PropModeReplace, prop, (int)nitems);
-                        resp.xselection.property = req->property;
-                    }
-                    XFree(prop);
-                }
-                XSendEvent(dpy, req->requestor, False, 0, &resp);
-                XFlush(dpy);
-            }
+        for (int i=0;i<MAX_DISPLAYS;i++) {
+            struct xdisplay *d = displays[i]; if (!d) continue;
+            if (!FD_ISSET(ConnectionNumber(d->dpy), &readfds) && XQLength(d->dpy) == 0) continue;
+            x_cur = i; process_display(d); x_cur = -1;
         }
     }
 
-    XCloseDisplay(dpy);
     return 0;
 }
@@ -1,7 +1,7 @@
 /* helper.c — minimal signed native helper (simple, small, no deps)
- * Usage: helper bindaddr <address>
+ * Usage: helper bindaddr <address> [origin]
  * Reads token from $XDG_RUNTIME_DIR/ultralock_http_token and port from $XDG_RUNTIME_DIR/ultralock_http_port
- * Sends GET /bindaddr?address=... with header X-Ultralock-Token: <token>
+ * Sends GET /bindaddr?address=...[&origin=...] with header X-Ultralock-Token: <token>
  * Built with: gcc -o helper helper.c
  */
 
@@ -43,8 +43,8 @@ static int http_get(const char *host, int port, const char *path, const char *to
 }
 
 int main(int argc, char **argv) {
-    if (argc < 3) { fprintf(stderr, "Usage: %s bindaddr <address>\n", argv[0]); return 2; }
-    const char *cmd = argv[1]; const char *addr = argv[2];
+    if (argc < 3) { fprintf(stderr, "Usage: %s bindaddr <address> [origin]\n", argv[0]); return 2; }
+    const char *cmd = argv[1]; const char *addr = argv[2]; const char *origin = argc > 3 ? argv[3] : NULL;
     const char *xdg = getenv("XDG_RUNTIME_DIR"); char tokenpath[1024]; char portpath[1024];
     if (xdg && xdg[0]) { snprintf(tokenpath, sizeof(tokenpath), "%s/ultralock_http_token", xdg); snprintf(portpath, sizeof(portpath), "%s/ultralock_http_port", xdg); }
     else { const char *home = getenv("HOME"); snprintf(tokenpath, sizeof(tokenpath), "%s/.local/share/ultralock_http_token", home); snprintf(portpath, sizeof(portpath), "%s/.local/share/ultralock_http_port", home); }
@@ -53,10 +53,12 @@ int main(int argc, char **argv) {
     int port = atoi(portbuf); if (port <= 0) { fprintf(stderr, "Invalid port\n"); return 2; }
     if (strcmp(cmd, "bindaddr") == 0) {
         // prompt user for confirmation
-        printf("Bind address '%s'? Type YES to confirm: ", addr); fflush(stdout);
+        if (origin) printf("Bind address '%s' for origin '%s'? Type YES to confirm: ", addr, origin); else printf("Bind address '%s'? Type YES to confirm: ", addr);
+        fflush(stdout);
         char ans[16]; if (!fgets(ans, sizeof(ans), stdin)) return 2; if (strncmp(ans, "YES", 3) != 0) { printf("Aborted\n"); return 1; }
         char encoded[2048]; urlencode(addr, encoded, sizeof(encoded));
         char path[4096]; snprintf(path, sizeof(path), "/bindaddr?address=%s", encoded);
+        if (origin) { char eorigin[1024]; urlencode(origin, eorigin, sizeof(eorigin)); strncat(path, "&origin=", sizeof(path) - strlen(path) - 1); strncat(path, eorigin, sizeof(path) - strlen(path) - 1); }
         char resp[8192]; if (http_get("127.0.0.1", port, path, token, resp, sizeof(resp)) < 0) { fprintf(stderr, "Request failed\n"); return 2; }
         // print response body (simple parse)
         char *body = strstr(resp, "\r\n\r\n"); if (body) body += 4; else body = resp;
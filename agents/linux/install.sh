@@ -13,7 +13,7 @@ if ! command -v gcc >/dev/null; then
   echo "gcc not found. Please install build-essential or equivalent." >&2; exit 1
 fi
 
-gcc -o $BIN $SRC -lX11 -lm -lcrypto
+gcc -o $BIN $SRC -lX11 -lm -lcrypto -pthread
 sudo mv $BIN $DEST
 sudo chmod 755 $DEST
 
@@ -3,10 +3,11 @@
 # Usage: ./ipc_cli.sh LIST
 #        ./ipc_cli.sh "BIND <fp>"
 #        ./ipc_cli.sh "UNBIND <fp>"
+#        ULTRALOCK_SOCK=/run/ultralock.sock ./ipc_cli.sh DISPLAYS
 
 set -euo pipefail
 CMD="${1:-LIST}"
-SOCK="${XDG_RUNTIME_DIR:-$HOME/.local/share}/ultralock.sock"
+SOCK="${ULTRALOCK_SOCK:-${XDG_RUNTIME_DIR:-$HOME/.local/share}/ultralock.sock}"
 if command -v nc >/dev/null 2>&1; then
     # Use netcat with unix domain socket support (-U)
     if nc -h 2>&1 | grep -q -- "-U"; then
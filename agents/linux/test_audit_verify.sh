@@ -9,7 +9,7 @@ IPC="$ROOT/agents/linux/ipc_cli.sh"
 TEST_ADDR="bc1qw9cqf600jzcvkd53lpf6j9w93x806z5x5c0t8q"
 
 # Build
-gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -O2 || true
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
 gcc -o "$BRIDGE" "$ROOT/agents/linux/bridge.c" -O2 || true
 gcc -o "$VERIFY" "$ROOT/agents/linux/audit_verify.c" -O2 || true
 
@@ -30,6 +30,10 @@ PORT=$(grep -oP "127\\.0\\.0\\.1:\K\\d+" "$TMPOUT" | head -n1)
 TOKEN=$(grep -oP "Token: \K[0-9a-f]+" "$TMPOUT" | head -n1)
 
 curl -s "http://127.0.0.1:$PORT/bindaddr?address=$TEST_ADDR&token=$TOKEN" >/tmp/bridge_res.txt
+# addresses carrying the audit field separator are refused, so no client can split an audit entry
+for cmd in "VERIFYADDR bc1q|x" "UNBINDADDR bc1q|x" "BINDADDR ${TEST_ADDR}|x"; do
+    "$IPC" "$cmd" | grep -q "ERR invalid-addr" || { echo "'$cmd' not refused"; kill $BRIDGE_PID $CLIP_PID || true; exit 2; }
+done
 # wait for audit entries to appear
 sleep 0.1
 
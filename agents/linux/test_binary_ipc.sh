@@ -0,0 +1,41 @@
+#!/usr/bin/env bash
+# Binary IPC test/benchmark: runs bench_ipc against an isolated agent; both protocols must return the same answers.
+# Usage: ./test_binary_ipc.sh [binds] [verifies]   (defaults are small; use 100000 100000 for the benchmark)
+set -euo pipefail
+ROOT="$(cd "$(dirname "$0")/../../" && pwd)"
+CLIP="$ROOT/agents/linux/clipwatch"
+BENCH="$ROOT/agents/linux/bench_ipc"
+IPC="$ROOT/agents/linux/ipc_cli.sh"
+NBINDS="${1:-5000}"; NVERIFY="${2:-5000}"
+
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
+gcc -o "$BENCH" "$ROOT/agents/linux/bench_ipc.c" -O2 || true
+
+# isolated agent state so the random benchmark binds never reach the real bind store
+TMPD=$(mktemp -d)
+export XDG_RUNTIME_DIR="$TMPD/run" XDG_DATA_HOME="$TMPD/data"
+mkdir -p "$XDG_RUNTIME_DIR" "$XDG_DATA_HOME"
+"$CLIP" --daemon >"$TMPD/clip.log" 2>&1 &
+CLIP_PID=$!
+trap 'kill $CLIP_PID 2>/dev/null || true; rm -rf "$TMPD"' EXIT
+for i in {1..40}; do [ -S "$XDG_RUNTIME_DIR/ultralock.sock" ] && break; sleep 0.05; done
+
+"$BENCH" "$NBINDS" "$NVERIFY"
+# the text protocol still serves ipc_cli.sh
+"$IPC" "VERIFY $(printf '0%.0s' {1..64})" | grep -q "ERR notbound" || { echo "text protocol broken"; exit 2; }
+# one user cannot take every client slot: past the per-uid cap the agent answers ERR busy, and frees the slot on close
+if command -v python3 >/dev/null 2>&1; then
+python3 - "$XDG_RUNTIME_DIR/ultralock.sock" <<'PY' || { echo "per-uid client cap broken"; exit 2; }
+import socket, sys, time
+def conn():
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM); s.settimeout(5); s.connect(sys.argv[1]); return s
+def ask(s):
+    s.sendall(b"NAMESPACES\n"); return s.recv(4096).decode()
+held = [conn() for _ in range(16)]
+assert all(ask(s) for s in held)
+extra = conn(); assert extra.recv(64).startswith(b"ERR busy")
+held.pop().close(); time.sleep(0.3); again = conn()
+assert not ask(again).startswith("ERR busy")
+PY
+fi
+echo "address is safe and passed"
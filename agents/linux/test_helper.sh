@@ -8,7 +8,7 @@ HELP="$ROOT/agents/linux/helper"
 IPC="$ROOT/agents/linux/ipc_cli.sh"
 TEST_ADDR="bc1qw9cqf600jzcvkd53lpf6j9w93x806z5x5c0t8q"
 
-gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -O2 || true
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
 gcc -o "$BRIDGE" "$ROOT/agents/linux/bridge.c" -O2 || true
 gcc -o "$HELP" "$ROOT/agents/linux/helper.c" -O2 || true
 
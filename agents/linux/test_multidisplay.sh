@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+# Multi-display test: one agent attached to several Xvfb sessions; checks enforcement per display (a bound address
+# passes, an unbound one is replaced), dynamic add/drop, and that the per-display stats are sane
+set -euo pipefail
+ROOT="$(cd "$(dirname "$0")/../../" && pwd)"
+CLIP="$ROOT/agents/linux/clipwatch"
+IPC="$ROOT/agents/linux/ipc_cli.sh"
+TEST_ADDR="bc1qw9cqf600jzcvkd53lpf6j9w93x806z5x5c0t8q"
+BOUND_ADDR="bc1qar0srrr7xfkvy5l643lydnw9re59gtzzwf5mdq"
+
+if ! command -v Xvfb >/dev/null 2>&1 || ! command -v xclip >/dev/null 2>&1; then echo "SKIP: Xvfb and xclip are required"; exit 0; fi
+
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
+
+TMPD=$(mktemp -d)
+export XDG_RUNTIME_DIR="$TMPD/run" XDG_DATA_HOME="$TMPD/data" ULTRALOCK_SOCK="$TMPD/multi.sock"
+mkdir -p "$XDG_RUNTIME_DIR" "$XDG_DATA_HOME"
+LOG="$TMPD/clip.log"
+PIDS=()
+cleanup() { kill "${PIDS[@]}" 2>/dev/null || true; rm -rf "$TMPD"; }
+trap cleanup EXIT
+for n in 91 92 93; do Xvfb ":$n" -nolisten tcp >/dev/null 2>&1 & PIDS+=($!); eval "XVFB_$n=$!"; done
+sleep 0.5
+
+# one agent for all sessions
+"$CLIP" --multi --socket "$ULTRALOCK_SOCK" >"$LOG" 2>&1 &
+PIDS+=($!)
+
+wait_for() { # wait_for <grep pattern> [absent]
+    for i in {1..100}; do
+        OUT=$("$IPC" DISPLAYS 2>/dev/null || true)
+        if [ "${2-}" = "absent" ]; then echo "$OUT" | grep -q "$1" || return 0; else echo "$OUT" | grep -q "$1" && return 0; fi
+        sleep 0.1
+    done
+    echo "timeout waiting for '$1' ${2-}"; echo "$OUT"; cat "$LOG"; exit 2
+}
+wait_for "DPY :91 " && wait_for "DPY :92 " && wait_for "DPY :93 "
+
+# the Xvfb sessions are ours, so our binds apply: a bound address copied in :91 must be left alone
+"$IPC" "BINDADDR $BOUND_ADDR" | grep -q "^OK" || { echo "bind failed"; exit 2; }
+echo -n "$BOUND_ADDR" | DISPLAY=:91 xclip -selection clipboard -i
+wait_for "DPY :91 .* changes [1-9]"
+[ "$(DISPLAY=:91 xclip -selection clipboard -o)" = "$BOUND_ADDR" ] || { echo "bound address replaced on :91"; exit 2; }
+
+# an unbound address copied in :92 must be replaced there, and only there
+echo -n "$TEST_ADDR" | DISPLAY=:92 xclip -selection clipboard -i
+wait_for "DPY :92 .* blocked [1-9]"
+DISPLAY=:92 xclip -selection clipboard -o | grep -q "UltraLock ALERT" || { echo "clipboard on :92 not replaced"; exit 2; }
+"$IPC" DISPLAYS | grep -q "DPY :91 .* blocked 0 " || { echo "unexpected enforcement on :91"; exit 2; }
+
+# sessions come and go
+kill "$XVFB_93"; wait_for "DPY :93 " absent
+Xvfb :94 -nolisten tcp >/dev/null 2>&1 & PIDS+=($!)
+wait_for "DPY :94 "
+
+# per-display enforcement latency and memory: every display polled, latency ordered and bounded, memory within RSS
+"$IPC" DISPLAYS | tee "$TMPD/displays.txt"
+awk '/^DPY / { n++; for (i = 3; i < NF; i += 2) v[$i] = $(i + 1)
+               if (v["polls"] < 1 || v["lat_avg_us"] < 0 || v["lat_max_us"] < v["lat_avg_us"] || v["lat_max_us"] > 5000000 || v["mem_kb"] < 0) bad = bad "\n" $0
+               if (v["changes"] > 0) changed++; mem += v["mem_kb"] }
+     /^RSS / { rss = $2 } /^END$/ { end = 1 }
+     END { if (bad != "") { print "implausible display stats:" bad; exit 2 }
+           if (n != 3 || changed < 2 || !end || rss < 1 || mem > rss) { print "bad DISPLAYS output"; exit 2 } }' "$TMPD/displays.txt"
+echo "address is safe and passed"
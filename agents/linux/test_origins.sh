@@ -0,0 +1,116 @@
+#!/usr/bin/env bash
+# Origin namespace test: binds in one origin do not verify in another, survive a restart, and UNBINDORIGIN drops only its origin
+set -euo pipefail
+ROOT="$(cd "$(dirname "$0")/../../" && pwd)"
+CLIP="$ROOT/agents/linux/clipwatch"
+BRIDGE="$ROOT/agents/linux/bridge"
+IPC="$ROOT/agents/linux/ipc_cli.sh"
+TEST_ADDR="bc1qw9cqf600jzcvkd53lpf6j9w93x806z5x5c0t8q"
+OTHER_ADDR="bc1qar0srrr7xfkvy5l643lydnw9re59gtzzwf5mdq"
+
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
+gcc -o "$BRIDGE" "$ROOT/agents/linux/bridge.c" -O2 || true
+
+TMPD=$(mktemp -d)
+export XDG_RUNTIME_DIR="$TMPD/run" XDG_DATA_HOME="$TMPD/data"
+mkdir -p "$XDG_RUNTIME_DIR" "$XDG_DATA_HOME"
+CLIP_PID=""; BRIDGE_PID=""
+trap 'kill $CLIP_PID $BRIDGE_PID 2>/dev/null || true; rm -rf "$TMPD"' EXIT
+start_agent() {
+    rm -f "$XDG_RUNTIME_DIR/ultralock.sock"
+    "$CLIP" --daemon --ns-limit "${1:-2}" >"$TMPD/clip.log" 2>&1 &
+    CLIP_PID=$!
+    for i in {1..40}; do [ -S "$XDG_RUNTIME_DIR/ultralock.sock" ] && break; sleep 0.05; done
+}
+expect() { local got; got=$("$IPC" "$1" 2>/dev/null || true); echo "$got" | grep -q "$2" || { echo "'$1': expected '$2', got '$got'"; exit 2; }; }
+start_agent
+
+"$BRIDGE" >"$TMPD/bridge.out" 2>&1 &
+BRIDGE_PID=$!
+sleep 0.5
+PORT=$(grep -oP "127\\.0\\.0\\.1:\K\\d+" "$TMPD/bridge.out" | head -n1)
+TOKEN=$(grep -oP "Token: \K[0-9a-f]+" "$TMPD/bridge.out" | head -n1)
+[ -n "$PORT" ] && [ -n "$TOKEN" ] || { echo "Bridge failed to start"; exit 2; }
+
+# bind through the bridge with a url-encoded origin
+curl -s "http://127.0.0.1:$PORT/bindaddr?address=$TEST_ADDR&origin=https%3A%2F%2Fa.example&token=$TOKEN" | grep -q "OK" || { echo "bridge bind failed"; exit 2; }
+expect "VERIFYADDR $TEST_ADDR ORIGIN https://a.example" "^OK"
+expect "VERIFYADDR $TEST_ADDR ORIGIN https://b.example" "ERR notbound"
+expect "VERIFYADDR $TEST_ADDR" "ERR notbound"
+expect "BINDADDR $OTHER_ADDR ORIGIN https://b.example" "^OK"
+# an empty address right after a verify of a bound one must not reuse its canonical form
+GOT=$("$IPC" "VERIFYADDR $OTHER_ADDR ORIGIN https://b.example\nVERIFYADDR  ORIGIN https://b.example" | tr '\n' ' ')
+[ "$GOT" = "OK ERR notbound " ] || { echo "empty VERIFYADDR answered '$GOT'"; exit 2; }
+expect "BINDADDR $TEST_ADDR ORIGIN bad|origin" "ERR invalid-origin"
+# per-namespace limit (--ns-limit 2)
+expect "BIND $(printf '1%.0s' {1..64}) ORIGIN https://a.example" "^OK"
+expect "BIND $(printf '2%.0s' {1..64}) ORIGIN https://a.example" "ERR full"
+expect "NAMESPACES" "NS binds 2 limit 2 .* origin https://a.example"
+expect "LIST ORIGIN https://b.example" "FP "
+
+# per-user namespace cap: past it binds answer ERR full and leave no empty namespace behind
+if command -v python3 >/dev/null 2>&1; then
+python3 - "$XDG_RUNTIME_DIR/ultralock.sock" <<'PY' || { echo "per-user namespace cap broken"; exit 2; }
+import socket, sys
+s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM); s.settimeout(10); s.connect(sys.argv[1]); f = s.makefile("r")
+def ask(cmd):
+    s.sendall((cmd + "\n").encode()); return f.readline().strip()
+def namespaces():
+    s.sendall(b"NAMESPACES\n"); n = 0
+    while f.readline().strip() != "END": n += 1
+    return n
+have = namespaces(); replies = [ask("BIND %064x ORIGIN https://cap%d.example" % (i + 1, i)) for i in range(1024 - have + 1)]
+assert all(r == "OK" for r in replies[:-1]) and replies[-1] == "ERR full", replies[-3:]
+assert namespaces() == 1024
+for i in range(1024 - have): assert ask("UNBINDORIGIN https://cap%d.example" % i) == "OK"
+PY
+fi
+
+# bulk unbind of one origin leaves the others alone
+curl -s "http://127.0.0.1:$PORT/unbindorigin?origin=https%3A%2F%2Fa.example&token=$TOKEN" | grep -q "OK" || { echo "unbindorigin failed"; exit 2; }
+expect "VERIFYADDR $TEST_ADDR ORIGIN https://a.example" "ERR notbound"
+expect "VERIFYADDR $OTHER_ADDR ORIGIN https://b.example" "^OK"
+
+# binds persist through the journal, not a rewrite of the whole store per command
+[ "$(grep -c '|save-binds|' "$XDG_RUNTIME_DIR/ultralock_audit.log" || true)" -eq 0 ] || { echo "bind store rewritten per command"; exit 2; }
+[ -s "$XDG_DATA_HOME/ultralock_binds.txt.journal" ] || { echo "bind journal missing"; exit 2; }
+
+# namespaces survive a restart (address fingerprints are session-salted, so compare the stored entries)
+kill $CLIP_PID; wait $CLIP_PID 2>/dev/null || true
+start_agent
+expect "NAMESPACES" "NS binds 1 limit 2 .* origin https://b.example"
+expect "LIST ORIGIN https://a.example" "^END"
+expect "UNBINDORIGIN https://a.example" "ERR notfound"
+grep -q "|unbind-origin|https://a.example|" "$XDG_RUNTIME_DIR/ultralock_audit.log" || { echo "unbind-origin not audited"; exit 2; }
+
+# a lowered --ns-limit keeps the stored binds (even across the next save) and only refuses new ones
+expect "BINDADDR $TEST_ADDR ORIGIN https://b.example" "^OK"
+kill $CLIP_PID; wait $CLIP_PID 2>/dev/null || true
+start_agent 1
+expect "NAMESPACES" "NS binds 2 limit 1 .* origin https://b.example"
+expect "BIND $(printf '4%.0s' {1..64}) ORIGIN https://b.example" "ERR full"
+expect "BINDADDR $TEST_ADDR ORIGIN https://c.example" "^OK"
+grep -q "|load-binds-over-limit|uid=$(id -u) origin=https://b.example binds=2 limit=1|" "$XDG_RUNTIME_DIR/ultralock_audit.log" || { echo "over-limit load not audited"; exit 2; }
+kill $CLIP_PID; wait $CLIP_PID 2>/dev/null || true
+start_agent
+expect "NAMESPACES" "NS binds 2 limit 2 .* origin https://b.example"
+
+# a journal that outgrows the store is compacted into the snapshot once, and replays to the same state
+if command -v python3 >/dev/null 2>&1; then
+python3 - "$XDG_RUNTIME_DIR/ultralock.sock" <<'PY' || { echo "journal churn failed"; exit 2; }
+import socket, sys, threading
+s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM); s.settimeout(30); s.connect(sys.argv[1]); f = s.makefile("r")
+fp = "5" * 64; n = 34000
+# the agent stops reading a client whose replies are not drained, so send and read concurrently
+threading.Thread(target=s.sendall, args=(("BIND %s ORIGIN https://churn.example\nUNBIND %s ORIGIN https://churn.example\n" % (fp, fp)).encode() * n,), daemon=True).start()
+assert all(f.readline().strip() == "OK" for _ in range(2 * n))
+PY
+expect "BINDADDR $TEST_ADDR ORIGIN https://churn.example" "^OK"
+[ "$(grep -c '|save-binds|' "$XDG_RUNTIME_DIR/ultralock_audit.log")" -eq 1 ] || { echo "journal not compacted exactly once"; exit 2; }
+[ "$(wc -l <"$XDG_DATA_HOME/ultralock_binds.txt.journal")" -lt 34000 ] || { echo "journal not truncated after compaction"; exit 2; }
+kill $CLIP_PID; wait $CLIP_PID 2>/dev/null || true
+start_agent
+expect "NAMESPACES" "NS binds 1 limit 2 .* origin https://churn.example"
+expect "NAMESPACES" "NS binds 2 limit 2 .* origin https://b.example"
+fi
+echo "address is safe and passed"
@@ -0,0 +1,74 @@
+#!/usr/bin/env bash
+# Bulk scan test: clipwatch --scan over a generated payout export (file, stream and multi-threaded) must report
+# exactly the unbound addresses, in input order, identically in every mode, with one audit entry per scan.
+# Usage: ./test_scan.sh [rows]   (default 1000000 rows, ~78 MB, so the stream mode crosses a block boundary)
+set -euo pipefail
+ROOT="$(cd "$(dirname "$0")/../../" && pwd)"
+CLIP="$ROOT/agents/linux/clipwatch"
+VERIFY="$ROOT/agents/linux/audit_verify"
+IPC="$ROOT/agents/linux/ipc_cli.sh"
+ROWS="${1:-1000000}"
+command -v python3 >/dev/null 2>&1 || { echo "SKIP: python3 is required"; exit 0; }
+
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
+gcc -o "$VERIFY" "$ROOT/agents/linux/audit_verify.c" -O2 || true
+
+TMPD=$(mktemp -d)
+export XDG_RUNTIME_DIR="$TMPD/run" XDG_DATA_HOME="$TMPD/data"
+mkdir -p "$XDG_RUNTIME_DIR" "$XDG_DATA_HOME"
+AUDIT="$XDG_RUNTIME_DIR/ultralock_audit.log"
+"$CLIP" --daemon >"$TMPD/clip.log" 2>&1 &
+CLIP_PID=$!
+trap 'kill $CLIP_PID 2>/dev/null || true; rm -rf "$TMPD"' EXIT
+for i in {1..40}; do [ -S "$XDG_RUNTIME_DIR/ultralock.sock" ] && break; sleep 0.05; done
+
+# export with a few bound payees (some in upper case), unbound bech32 and 0x addresses, and decoys that are not candidates
+python3 - "$TMPD" "$ROWS" <<'PY'
+import random, sys
+d, rows = sys.argv[1], int(sys.argv[2]); random.seed(11)
+def bech(): return "bc1q" + "".join(random.choice("023456789acdefghjklmnpqrstuvwxyz") for _ in range(38))
+def eth(): return "0x" + "".join(random.choice("0123456789abcdef") for _ in range(40))
+bound = [bech(), bech(), eth()]; expect = []; off = 0
+with open(d + "/export.csv", "w") as f:
+    def w(s):
+        global off; f.write(s); off += len(s)
+    w("id,address,amount,memo\n")
+    for i in range(rows):
+        a = bound[i % 3]
+        if i % 997 == 0: a = bech() if i % 2 else eth()
+        elif i % 101 == 0: a = a.upper()[:2].lower() + a.upper()[2:]  # same address, other case
+        w("%d," % i)
+        if i % 997 == 0: expect.append("UNBOUND %d %s" % (off, a.lower()))
+        w("%s,%d.%02d,\"0x12 bc1short lnbc\"\n" % (a, i % 500, i % 100))
+open(d + "/bound.txt", "w").write("\n".join(bound) + "\n")
+open(d + "/expect.txt", "w").write("".join(l + "\n" for l in expect))
+PY
+while read -r a; do "$IPC" "BINDADDR $a" | grep -q "^OK" || { echo "bind failed"; exit 2; }; done <"$TMPD/bound.txt"
+
+rc=0; "$CLIP" --scan "$TMPD/export.csv" >"$TMPD/file.txt" || rc=$?
+[ "$rc" -eq 1 ] || { echo "expected exit 1 (unbound found), got $rc"; exit 2; }
+cmp -s "$TMPD/file.txt" "$TMPD/expect.txt" || { echo "file scan report differs from the expected unbound list"; diff "$TMPD/file.txt" "$TMPD/expect.txt" | head; exit 2; }
+"$CLIP" --scan - --threads 3 <"$TMPD/export.csv" >"$TMPD/stream.txt" || true
+"$CLIP" --scan "$TMPD/export.csv" --threads 8 >"$TMPD/threads.txt" || true
+cmp -s "$TMPD/file.txt" "$TMPD/stream.txt" || { echo "stream scan report differs"; exit 2; }
+cmp -s "$TMPD/file.txt" "$TMPD/threads.txt" || { echo "multi-threaded scan report differs"; exit 2; }
+
+# one summarizing audit entry per scan, carrying the digest of the report
+[ "$(grep -c '|scan|' "$AUDIT")" -eq 3 ] || { echo "expected 3 scan audit entries"; exit 2; }
+SHA=$(sha256sum "$TMPD/file.txt" | cut -d' ' -f1)
+[ "$(grep '|scan|' "$AUDIT" | grep -c "unbound=$(wc -l <"$TMPD/expect.txt") .*report_sha256=$SHA|")" -eq 3 ] || { echo "scan audit entries do not match the report"; exit 2; }
+"$VERIFY" | grep -q "audit OK" || { echo "audit chain broken"; exit 2; }
+
+# a report that cannot be written is an error, and its audit entry says so
+if [ -w /dev/full ]; then
+    rc=0; "$CLIP" --scan "$TMPD/export.csv" >/dev/full 2>/dev/null || rc=$?
+    [ "$rc" -eq 2 ] || { echo "scan to a full stdout should exit 2, got $rc"; exit 2; }
+    grep '|scan|' "$AUDIT" | tail -n1 | grep -q " incomplete=1 " || { echo "unwritten report not audited as incomplete"; exit 2; }
+fi
+
+# everything bound: exit 0; the bind set is per origin
+tr '\n' ' ' <"$TMPD/bound.txt" >"$TMPD/clean.txt"
+"$CLIP" --scan "$TMPD/clean.txt" >/dev/null || { echo "all-bound input should exit 0"; exit 2; }
+rc=0; "$CLIP" --scan "$TMPD/clean.txt" --origin https://other.example >/dev/null || rc=$?
+[ "$rc" -eq 1 ] || { echo "addresses bound in the default origin must not count for another origin"; exit 2; }
+echo "address is safe and passed"
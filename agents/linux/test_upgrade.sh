@@ -0,0 +1,91 @@
+#!/usr/bin/env bash
+# Live upgrade test: SIGHUP and UPGRADE hand the sockets and state to a fresh process while clients keep querying.
+# Measures the service gap (worst query latency across the handoff); no connection may be refused or dropped, and
+# a bound address must keep verifying (the session nonce is carried over). Also checks that a broken binary is rolled back.
+set -euo pipefail
+ROOT="$(cd "$(dirname "$0")/../../" && pwd)"
+CLIP="$ROOT/agents/linux/clipwatch"
+VERIFY="$ROOT/agents/linux/audit_verify"
+TEST_ADDR="bc1qw9cqf600jzcvkd53lpf6j9w93x806z5x5c0t8q"
+command -v python3 >/dev/null 2>&1 || { echo "SKIP: python3 is required"; exit 0; }
+
+gcc -o "$CLIP" "$ROOT/agents/linux/clipwatch.c" -lX11 -lm -pthread -O2 || true
+gcc -o "$VERIFY" "$ROOT/agents/linux/audit_verify.c" -O2 || true
+
+# isolated agent state; the agent runs from a private copy so the binary can be swapped underneath it
+TMPD=$(mktemp -d)
+export XDG_RUNTIME_DIR="$TMPD/run" XDG_DATA_HOME="$TMPD/data"
+mkdir -p "$XDG_RUNTIME_DIR" "$XDG_DATA_HOME"
+SOCK="$XDG_RUNTIME_DIR/ultralock.sock"; AUDIT="$XDG_RUNTIME_DIR/ultralock_audit.log"
+cp "$CLIP" "$TMPD/clipwatch"
+"$TMPD/clipwatch" --daemon >"$TMPD/clip.log" 2>&1 &
+CLIP_PID=$!
+trap 'pkill -f "$TMPD/clipwatch" 2>/dev/null || true; rm -rf "$TMPD"' EXIT
+for i in {1..40}; do [ -S "$SOCK" ] && break; sleep 0.05; done
+
+python3 - "$SOCK" "$AUDIT" "$CLIP_PID" "$TEST_ADDR" <<'PY'
+import os, signal, socket, sys, threading, time
+sock, audit, pid, addr = sys.argv[1], sys.argv[2], int(sys.argv[3]), sys.argv[4]
+def conn():
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM); s.settimeout(15); s.connect(sock); return s
+def ask(s, cmd):
+    s.sendall((cmd + "\n").encode()); buf = b""
+    while not buf.endswith(b"\n"):
+        d = s.recv(4096)
+        if not d: raise ConnectionError("agent closed the connection")
+        buf += d
+    return buf.decode().strip()
+def takeovers(): return sum(1 for l in open(audit) if "|takeover|" in l)
+
+p = conn()
+assert ask(p, "BINDADDR " + addr) == "OK"
+stop = False; stats = {"fresh": [0, 0.0, 0], "kept": [0, 0.0, 0]}  # queries, worst latency, failures
+def loop(kind):
+    s = conn() if kind == "kept" else None
+    while not stop:
+        t = time.monotonic()
+        try:
+            c = s or conn(); ok = ask(c, "VERIFYADDR " + addr) == "OK"
+            if not s: c.close()
+        except OSError as e:
+            ok = False; print(kind, "error:", e)
+        st = stats[kind]; st[0] += 1; st[1] = max(st[1], time.monotonic() - t); st[2] += not ok
+threads = [threading.Thread(target=loop, args=(k,)) for k in ("fresh", "kept")]
+for t in threads: t.start()
+time.sleep(0.3)
+# upgrade 1: SIGHUP
+os.kill(pid, signal.SIGHUP)
+deadline = time.time() + 10
+while takeovers() < 1 and time.time() < deadline: time.sleep(0.01)
+time.sleep(0.3)
+# upgrade 2: UPGRADE over a connection that is itself handed over
+assert ask(p, "UPGRADE") == "OK upgrading"
+while takeovers() < 2 and time.time() < deadline: time.sleep(0.01)
+time.sleep(0.3)
+stop = True
+for t in threads: t.join()
+assert takeovers() == 2, "upgrades did not complete"
+assert ask(p, "VERIFYADDR " + addr) == "OK", "bound address no longer verifies after upgrade"
+for kind, (n, worst, fails) in stats.items():
+    print("%-5s connections: %6d queries, service gap (worst latency) %7.2f ms, failures %d" % (kind, n, worst * 1000, fails))
+    assert fails == 0, kind + " queries failed across the upgrade"
+PY
+
+# a binary that fails to start is rolled back: the running agent keeps serving
+NEW_PID=$(pgrep -f "$TMPD/clipwatch" | head -n1)
+mv "$TMPD/clipwatch" "$TMPD/clipwatch.good"; printf '#!/bin/sh\nexit 1\n' >"$TMPD/clipwatch"; chmod +x "$TMPD/clipwatch"
+kill -HUP "$NEW_PID"
+for i in {1..100}; do grep -q "|upgrade-failed|child-exited|" "$AUDIT" && break; sleep 0.05; done
+grep -q "|upgrade-failed|child-exited|" "$AUDIT" || { echo "failed upgrade not rolled back"; exit 2; }
+kill -0 "$NEW_PID" || { echo "agent died on a failed upgrade"; exit 2; }
+printf 'VERIFYADDR %s\n' "$TEST_ADDR" | python3 -c "import socket,sys; s=socket.socket(socket.AF_UNIX); s.connect('$SOCK'); s.sendall(sys.stdin.buffer.read()); print(s.recv(64).decode().strip())" | grep -q "^OK" || { echo "agent not serving after failed upgrade"; exit 2; }
+"$VERIFY" | grep -q "audit OK" || { echo "audit chain broken across upgrades"; exit 2; }
+
+# SIGTERM during a (slow) handoff is held and forwarded: the new process takes over, then shuts down, on one chain
+printf '#!/bin/sh\nsleep 0.5\nexec "%s" "$@"\n' "$TMPD/clipwatch.good" >"$TMPD/clipwatch"
+kill -HUP "$NEW_PID"; sleep 0.2; kill -TERM "$NEW_PID"
+for i in {1..100}; do pgrep -f "$TMPD/clipwatch" >/dev/null || break; sleep 0.05; done
+pgrep -f "$TMPD/clipwatch" >/dev/null && { echo "agent still running after SIGTERM during upgrade"; exit 2; }
+[ "$(tail -n2 "$AUDIT" | cut -d'|' -f2 | tr '\n' ' ')" = "takeover shutdown " ] || { echo "SIGTERM during upgrade not forwarded to the new process"; tail -n4 "$AUDIT"; exit 2; }
+"$VERIFY" | grep -q "audit OK" || { echo "audit chain forked by SIGTERM during upgrade"; exit 2; }
+echo "address is safe and passed"